@@ -3,27 +3,2586 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 #include <algorithm>
 #include <cctype>
+#include <cmath>
 #include <iomanip>
 #include <sstream>
 #include <ctime>
+#include <memory>
+#include <functional>
+#include <optional>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <regex>
+#include <random>
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#include <share.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Global database connection; thread-local so report workers can each bind
+// their own shard connection
+thread_local sqlite3* db;
+
+// Busy handler: while another connection holds the write lock, back off
+// exponentially with jitter so co-writers don't retry in lockstep; gives up
+// (SQLITE_BUSY) after about a second. Each thread has its own randomly seeded
+// generator, so processes and shard workers don't share a jitter sequence.
+int busyBackoff(void*, int attempt) {
+    if (attempt >= 12) return 0;
+    thread_local mt19937 jitter(random_device{}());
+    int delay = min(1 << attempt, 250);
+    this_thread::sleep_for(chrono::milliseconds(uniform_int_distribution<int>(delay / 2, delay)(jitter)));
+    return 1;
+}
+
+// Settings every connection needs: foreign key enforcement is off by
+// default and per connection, and the busy handler above
+void configureConnection(sqlite3* conn) {
+    sqlite3_exec(conn, "PRAGMA foreign_keys = ON;", 0, 0, 0);
+    sqlite3_busy_handler(conn, busyBackoff, nullptr);
+}
+
+// fopen is deprecated under /sdl; _fsopen (unlike fopen_s) leaves the file
+// shareable, which the logs other processes append to rely on
+FILE* openFile(const string& path, const char* mode) {
+#if defined(_WIN32)
+    return _fsopen(path.c_str(), mode, _SH_DENYNO);
+#else
+    return fopen(path.c_str(), mode);
+#endif
+}
+
+// Exclusive advisory lock on a whole file, shared by every process appending to
+// it; with wait false, returns false instead of waiting for another holder
+bool lockFile(FILE* file, bool lock, bool wait = true) {
+#if defined(_WIN32)
+    HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file)));
+    OVERLAPPED overlapped = {};
+    if (!lock) return UnlockFileEx(handle, 0, MAXDWORD, MAXDWORD, &overlapped) != 0;
+    DWORD flags = LOCKFILE_EXCLUSIVE_LOCK | (wait ? 0 : LOCKFILE_FAIL_IMMEDIATELY);
+    return LockFileEx(handle, flags, 0, MAXDWORD, MAXDWORD, &overlapped) != 0;
+#else
+    struct flock range = {};
+    range.l_type = lock ? F_WRLCK : F_UNLCK;
+    range.l_whence = SEEK_SET;
+    int rc;
+    while ((rc = fcntl(fileno(file), wait ? F_SETLKW : F_SETLK, &range)) == -1 && errno == EINTR) {}
+    return rc != -1;
+#endif
+}
+
+// Change data capture: every committed row change is appended to a binary,
+// sequence-numbered log that consumers can tail by byte offset and replay.
+//
+// File layout: "UCDC" + format byte, then records of
+//   varint length | varint seq | varint unix time | op ('I', 'U', 'D')
+//   | varint table length + table | zigzag rowid | varint column count | values
+// where each value is a type byte followed by a zigzag varint (integer),
+// 8 raw bytes (real), or varint length + bytes (text, blob).
+// Sequence numbers are assigned while holding the file lock, continuing from
+// the last record in the file, so several processes can share one log.
+string changeLogPath = "university.cdc";
+FILE* changeLog = nullptr;
+unsigned long long nextChangeSeq = 1;
+const char changeLogMagic[] = { 'U', 'C', 'D', 'C', 1 };
+long long changeLogScanned = sizeof(changeLogMagic); // offset up to which nextChangeSeq is known
+
+struct ChangeValue {
+    int type = SQLITE_NULL;
+    sqlite3_int64 integer = 0;
+    double real = 0.0;
+    string bytes;
+};
+
+struct ChangeRecord {
+    unsigned long long seq = 0;
+    long long timestamp = 0;
+    char op = 'I';
+    string table;
+    sqlite3_int64 rowid = 0;
+    vector<ChangeValue> values;
+};
+
+void putVarint(string& out, unsigned long long value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+void putSigned(string& out, long long value) {
+    putVarint(out, (static_cast<unsigned long long>(value) << 1) ^ static_cast<unsigned long long>(value >> 63));
+}
+
+bool getVarint(const string& in, size_t& pos, unsigned long long& value) {
+    value = 0;
+    for (int shift = 0; pos < in.size() && shift < 64; shift += 7) {
+        unsigned char byte = static_cast<unsigned char>(in[pos++]);
+        value |= static_cast<unsigned long long>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool getSigned(const string& in, size_t& pos, long long& value) {
+    unsigned long long raw;
+    if (!getVarint(in, pos, raw)) return false;
+    value = static_cast<long long>(raw >> 1) ^ -static_cast<long long>(raw & 1);
+    return true;
+}
+
+string encodeChange(const ChangeRecord& change) {
+    string body;
+    putVarint(body, change.seq);
+    putVarint(body, static_cast<unsigned long long>(change.timestamp));
+    body.push_back(change.op);
+    putVarint(body, change.table.size());
+    body += change.table;
+    putSigned(body, change.rowid);
+    putVarint(body, change.values.size());
+    for (const auto& value : change.values) {
+        body.push_back(static_cast<char>(value.type));
+        if (value.type == SQLITE_INTEGER) {
+            putSigned(body, value.integer);
+        }
+        else if (value.type == SQLITE_FLOAT) {
+            char raw[sizeof(double)];
+            memcpy(raw, &value.real, sizeof(raw));
+            body.append(raw, sizeof(raw));
+        }
+        else if (value.type == SQLITE_TEXT || value.type == SQLITE_BLOB) {
+            putVarint(body, value.bytes.size());
+            body += value.bytes;
+        }
+    }
+    string record;
+    putVarint(record, body.size());
+    return record + body;
+}
+
+bool decodeChange(const string& body, ChangeRecord& change) {
+    size_t pos = 0;
+    unsigned long long timestamp, tableLength, columns;
+    if (!getVarint(body, pos, change.seq) || !getVarint(body, pos, timestamp) || pos >= body.size()) return false;
+    change.timestamp = static_cast<long long>(timestamp);
+    change.op = body[pos++];
+    if (!getVarint(body, pos, tableLength) || pos + tableLength > body.size()) return false;
+    change.table = body.substr(pos, tableLength);
+    pos += tableLength;
+    long long rowid;
+    if (!getSigned(body, pos, rowid) || !getVarint(body, pos, columns)) return false;
+    change.rowid = rowid;
+    change.values.assign(columns, ChangeValue());
+    for (auto& value : change.values) {
+        if (pos >= body.size()) return false;
+        value.type = body[pos++];
+        if (value.type == SQLITE_INTEGER) {
+            long long integer;
+            if (!getSigned(body, pos, integer)) return false;
+            value.integer = integer;
+        }
+        else if (value.type == SQLITE_FLOAT) {
+            if (pos + sizeof(double) > body.size()) return false;
+            memcpy(&value.real, body.data() + pos, sizeof(double));
+            pos += sizeof(double);
+        }
+        else if (value.type == SQLITE_TEXT || value.type == SQLITE_BLOB) {
+            unsigned long long length;
+            if (!getVarint(body, pos, length) || pos + length > body.size()) return false;
+            value.bytes = body.substr(pos, length);
+            pos += length;
+        }
+    }
+    return true;
+}
+
+// Each database file has its own log next to it: university.db -> university.cdc
+void switchChangeLog(const string& databaseFile) {
+    if (changeLog) fclose(changeLog);
+    changeLog = nullptr;
+    nextChangeSeq = 1;
+    changeLogScanned = sizeof(changeLogMagic);
+    size_t dot = databaseFile.rfind('.');
+    changeLogPath = (dot == string::npos ? databaseFile : databaseFile.substr(0, dot)) + ".cdc";
+}
+
+// Reads the record starting at offset; advances offset past it on success
+bool readChange(FILE* file, long long& offset, ChangeRecord& change) {
+    if (fseek(file, static_cast<long>(offset), SEEK_SET) != 0) return false;
+    string length;
+    int c;
+    while ((c = fgetc(file)) != EOF) {
+        length.push_back(static_cast<char>(c));
+        if (!(c & 0x80)) break;
+    }
+    size_t pos = 0;
+    unsigned long long bodyLength;
+    if (c == EOF || !getVarint(length, pos, bodyLength)) return false;
+    string body(bodyLength, '\0');
+    if (fread(&body[0], 1, bodyLength, file) != bodyLength || !decodeChange(body, change)) return false;
+    offset += static_cast<long long>(length.size() + bodyLength);
+    return true;
+}
+
+// Row changes reported by the update hook, waiting for their transaction to commit
+struct PendingChange {
+    char op;
+    string table;
+    sqlite3_int64 rowid;
+};
+vector<PendingChange> pendingChanges;
+
+void captureChange(int op, const char* table, sqlite3_int64 rowid) {
+    char code = op == SQLITE_INSERT ? 'I' : (op == SQLITE_DELETE ? 'D' : 'U');
+    pendingChanges.push_back({ code, table, rowid });
+}
+
+void onRollback(void*) {
+    pendingChanges.clear();
+}
+
+bool openChangeLog() {
+    if (changeLog) return true;
+    changeLog = openFile(changeLogPath, "a+b");
+    if (!changeLog) {
+        cerr << "Can't open change log: " << changeLogPath << endl;
+        return false;
+    }
+    return true;
+}
+
+// Appends records under the file lock, numbering them after whatever this or
+// any other process has written so far
+void appendChanges(vector<ChangeRecord>& changes) {
+    lockFile(changeLog, true);
+    fseek(changeLog, 0, SEEK_END);
+    if (ftell(changeLog) == 0) {
+        fwrite(changeLogMagic, 1, sizeof(changeLogMagic), changeLog);
+        fflush(changeLog);
+    }
+    ChangeRecord last;
+    while (readChange(changeLog, changeLogScanned, last)) {
+        nextChangeSeq = last.seq + 1;
+    }
+    string buffer;
+    for (auto& change : changes) {
+        change.seq = nextChangeSeq++;
+        buffer += encodeChange(change);
+    }
+    fseek(changeLog, 0, SEEK_END);
+    fwrite(buffer.data(), 1, buffer.size(), changeLog);
+    fflush(changeLog);
+    changeLogScanned = ftell(changeLog);
+    lockFile(changeLog, false);
+}
+
+// Appends committed changes with the row images as they are after the commit.
+// The update hook itself may not query the database, so rows are read here.
+void flushChangeCapture() {
+    if (pendingChanges.empty() || !sqlite3_get_autocommit(db) || !openChangeLog()) return;
+
+    vector<PendingChange> changes;
+    changes.swap(pendingChanges);
+
+    // Collapse repeated changes to a row into its final state
+    map<pair<string, sqlite3_int64>, size_t> latest;
+    vector<PendingChange> collapsed;
+    for (auto& change : changes) {
+        auto key = make_pair(change.table, change.rowid);
+        auto it = latest.find(key);
+        if (it == latest.end()) {
+            latest[key] = collapsed.size();
+            collapsed.push_back(change);
+        }
+        else if (collapsed[it->second].op != 'I' || change.op == 'D') {
+            collapsed[it->second].op = change.op;
+        }
+    }
+
+    map<string, sqlite3_stmt*> rowQueries;
+    vector<ChangeRecord> records;
+    long long now = static_cast<long long>(time(nullptr));
+    for (const auto& pending : collapsed) {
+        ChangeRecord change;
+        change.timestamp = now;
+        change.op = pending.op;
+        change.table = pending.table;
+        change.rowid = pending.rowid;
+
+        if (change.op != 'D') {
+            sqlite3_stmt*& stmt = rowQueries[change.table];
+            if (!stmt) {
+                string sql = "SELECT * FROM \"" + change.table + "\" WHERE rowid = ?;";
+                sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0);
+            }
+            if (!stmt) continue;
+            sqlite3_reset(stmt);
+            sqlite3_bind_int64(stmt, 1, change.rowid);
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                int columns = sqlite3_column_count(stmt);
+                change.values.resize(columns);
+                for (int i = 0; i < columns; ++i) {
+                    ChangeValue& value = change.values[i];
+                    value.type = sqlite3_column_type(stmt, i);
+                    if (value.type == SQLITE_INTEGER) value.integer = sqlite3_column_int64(stmt, i);
+                    else if (value.type == SQLITE_FLOAT) value.real = sqlite3_column_double(stmt, i);
+                    else if (value.type != SQLITE_NULL) {
+                        const char* data = static_cast<const char*>(sqlite3_column_blob(stmt, i));
+                        value.bytes.assign(data ? data : "", sqlite3_column_bytes(stmt, i));
+                    }
+                }
+            }
+            else if (change.op == 'I') {
+                continue; // inserted and removed again before the commit
+            }
+            else {
+                change.op = 'D';
+            }
+        }
+        records.push_back(change);
+    }
+    for (auto& query : rowQueries) {
+        sqlite3_finalize(query.second);
+    }
+    if (!records.empty()) appendChanges(records);
+}
+
+string describeValue(const ChangeValue& value) {
+    ostringstream out;
+    if (value.type == SQLITE_INTEGER) out << value.integer;
+    else if (value.type == SQLITE_FLOAT) out << value.real;
+    else if (value.type == SQLITE_TEXT) out << "'" << value.bytes << "'";
+    else if (value.type == SQLITE_BLOB) out << "<" << value.bytes.size() << " bytes>";
+    else out << "NULL";
+    return out.str();
+}
+
+// Prints every change from the given offset and the offset to resume from
+int tailChangeLog(long long offset) {
+    FILE* file = openFile(changeLogPath, "rb");
+    if (!file) {
+        cerr << "Can't open change log: " << changeLogPath << endl;
+        return 1;
+    }
+    if (offset < static_cast<long long>(sizeof(changeLogMagic))) offset = sizeof(changeLogMagic);
+
+    ChangeRecord change;
+    long long recordOffset = offset;
+    while (readChange(file, offset, change)) {
+        time_t when = static_cast<time_t>(change.timestamp);
+        char stamp[20];
+        struct tm timeinfo;
+#if defined(_WIN32) || defined(_WIN64)
+        localtime_s(&timeinfo, &when);
+#else
+        localtime_r(&when, &timeinfo);
+#endif
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &timeinfo);
+
+        cout << "#" << change.seq << " @" << recordOffset << " " << stamp << " "
+            << (change.op == 'I' ? "INSERT" : (change.op == 'U' ? "UPDATE" : "DELETE"))
+            << " " << change.table << " rowid=" << change.rowid;
+        if (!change.values.empty()) {
+            cout << " [";
+            for (size_t i = 0; i < change.values.size(); ++i) {
+                if (i) cout << ", ";
+                cout << describeValue(change.values[i]);
+            }
+            cout << "]";
+        }
+        cout << "\n";
+        recordOffset = offset;
+    }
+    fclose(file);
+    cout << "Next offset: " << offset << endl;
+    return 0;
+}
+
+// Applies changes from the given offset to another database with the same schema
+// Attendance partitions are created with DDL, which the change log doesn't
+// carry; replay creates them from the same definition (in the partition code)
+string attendanceTableSql(const string& table, bool foreignKeys = true);
+
+// Applies changes from offset in order and stops at the first one that can't
+// be applied, so the reported offset never skips past a lost change
+int replayChangeLog(const string& targetPath, long long offset) {
+    FILE* file = openFile(changeLogPath, "rb");
+    if (!file) {
+        cerr << "Can't open change log: " << changeLogPath << endl;
+        return 1;
+    }
+    sqlite3* target;
+    if (sqlite3_open(targetPath.c_str(), &target)) {
+        cerr << "Can't open database: " << sqlite3_errmsg(target) << endl;
+        sqlite3_close(target);
+        fclose(file);
+        return 1;
+    }
+    configureConnection(target);
+    if (offset < static_cast<long long>(sizeof(changeLogMagic))) offset = sizeof(changeLogMagic);
+
+    map<string, vector<string>> columnsByTable;
+    auto loadColumns = [target](const string& table, vector<string>& columns) {
+        string sql = "PRAGMA table_info(\"" + table + "\");";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(target, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                columns.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)));
+            }
+        }
+        sqlite3_finalize(stmt);
+    };
+    sqlite3_exec(target, "BEGIN;", 0, 0, 0);
+    ChangeRecord change;
+    long long applied = 0;
+    long long recordOffset = offset;
+    bool stopped = false;
+    while (!stopped && readChange(file, offset, change)) {
+        vector<string>& columns = columnsByTable[change.table];
+        if (columns.empty()) {
+            loadColumns(change.table, columns);
+        }
+        if (columns.empty() && change.table.rfind("attendance_", 0) == 0 && change.table != "attendance_partitions") {
+            sqlite3_exec(target, attendanceTableSql(change.table).c_str(), 0, 0, 0);
+            loadColumns(change.table, columns);
+        }
+        if (columns.empty() || (change.op != 'D' && columns.size() != change.values.size())) {
+            cerr << "Can't apply change #" << change.seq << ": table " << change.table << " does not match" << endl;
+            stopped = true;
+            break;
+        }
+
+        string sql;
+        if (change.op == 'D') {
+            sql = "DELETE FROM \"" + change.table + "\" WHERE rowid = ?;";
+        }
+        else {
+            string names = "rowid", params = "?";
+            for (const auto& column : columns) {
+                names += ", \"" + column + "\"";
+                params += ", ?";
+            }
+            sql = "INSERT OR REPLACE INTO \"" + change.table + "\" (" + names + ") VALUES (" + params + ");";
+        }
+
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(target, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+            cerr << "Replay error at #" << change.seq << ": " << sqlite3_errmsg(target) << endl;
+            stopped = true;
+            break;
+        }
+        sqlite3_bind_int64(stmt, 1, change.rowid);
+        for (size_t i = 0; change.op != 'D' && i < change.values.size(); ++i) {
+            const ChangeValue& value = change.values[i];
+            int param = static_cast<int>(i) + 2;
+            if (value.type == SQLITE_INTEGER) sqlite3_bind_int64(stmt, param, value.integer);
+            else if (value.type == SQLITE_FLOAT) sqlite3_bind_double(stmt, param, value.real);
+            else if (value.type == SQLITE_TEXT) sqlite3_bind_text(stmt, param, value.bytes.c_str(), static_cast<int>(value.bytes.size()), SQLITE_TRANSIENT);
+            else if (value.type == SQLITE_BLOB) sqlite3_bind_blob(stmt, param, value.bytes.data(), static_cast<int>(value.bytes.size()), SQLITE_TRANSIENT);
+            else sqlite3_bind_null(stmt, param);
+        }
+        if (sqlite3_step(stmt) == SQLITE_DONE) {
+            ++applied;
+            recordOffset = offset;
+        }
+        else {
+            cerr << "Replay error at #" << change.seq << ": " << sqlite3_errmsg(target) << endl;
+            stopped = true;
+        }
+        sqlite3_finalize(stmt);
+    }
+    // Everything before the failed change is kept; resume from that change
+    sqlite3_exec(target, "COMMIT;", 0, 0, 0);
+    sqlite3_close(target);
+    fclose(file);
+    cout << "Applied " << applied << " changes. Next offset: " << recordOffset << endl;
+    return stopped ? 1 : 0;
+}
+
+// Online backup: copies the database a few pages per step through the SQLite
+// backup API on its own connections, releasing the source lock between steps
+// so interactive users keep reading and writing. The copy is a consistent
+// snapshot; the API restarts it if another connection writes mid-copy.
+const char* databasePath = "university.db";
+
+struct BackupOptions {
+    int pagesPerStep = 64;
+    int sleepMs = 10;      // pause between steps, 0 to copy at full speed
+    bool compress = false;
+    bool progress = false; // print pages copied per second while running
+    bool report = true;    // print a summary when done
+};
+
+// Compressed snapshots keep literal bytes and collapse runs of zero bytes,
+// which make up most of the free space inside SQLite pages:
+//   "UDBZ" + format byte, then repeated varint literal length | literal | varint zero run
+const char compressedMagic[] = { 'U', 'D', 'B', 'Z', 1 };
+
+bool compressFile(const string& sourcePath, const string& destPath) {
+    FILE* in = openFile(sourcePath, "rb");
+    FILE* out = in ? openFile(destPath, "wb") : nullptr;
+    if (!in || !out) {
+        if (in) fclose(in);
+        return false;
+    }
+    fwrite(compressedMagic, 1, sizeof(compressedMagic), out);
+
+    const size_t minZeroRun = 8;
+    vector<char> chunk(1 << 20);
+    string encoded;
+    size_t read;
+    while ((read = fread(chunk.data(), 1, chunk.size(), in)) > 0) {
+        encoded.clear();
+        size_t pos = 0;
+        while (pos < read) {
+            size_t literalStart = pos, zeroStart = read, zeroEnd = read;
+            for (size_t i = pos; i < read; ++i) {
+                if (chunk[i] != 0) continue;
+                size_t j = i;
+                while (j < read && chunk[j] == 0) ++j;
+                if (j - i >= minZeroRun || j == read) {
+                    zeroStart = i;
+                    zeroEnd = j;
+                    break;
+                }
+                i = j;
+            }
+            putVarint(encoded, zeroStart - literalStart);
+            encoded.append(chunk.data() + literalStart, zeroStart - literalStart);
+            putVarint(encoded, zeroEnd - zeroStart);
+            pos = zeroEnd;
+        }
+        fwrite(encoded.data(), 1, encoded.size(), out);
+    }
+    fclose(in);
+    return fclose(out) == 0;
+}
+
+bool decompressFile(const string& sourcePath, const string& destPath) {
+    FILE* in = openFile(sourcePath, "rb");
+    if (!in) return false;
+    char magic[sizeof(compressedMagic)];
+    if (fread(magic, 1, sizeof(magic), in) != sizeof(magic) || memcmp(magic, compressedMagic, sizeof(magic)) != 0) {
+        fclose(in);
+        return false;
+    }
+    FILE* out = openFile(destPath, "wb");
+    if (!out) {
+        fclose(in);
+        return false;
+    }
+
+    auto readVarint = [in](unsigned long long& value) {
+        value = 0;
+        int c;
+        for (int shift = 0; shift < 64 && (c = fgetc(in)) != EOF; shift += 7) {
+            value |= static_cast<unsigned long long>(c & 0x7F) << shift;
+            if (!(c & 0x80)) return true;
+        }
+        return false;
+    };
+
+    bool ok = true;
+    vector<char> buffer;
+    unsigned long long literal, zeros;
+    while (readVarint(literal)) {
+        buffer.resize(literal);
+        if (fread(buffer.data(), 1, literal, in) != literal || !readVarint(zeros)) {
+            ok = false;
+            break;
+        }
+        fwrite(buffer.data(), 1, literal, out);
+        buffer.assign(zeros, 0);
+        fwrite(buffer.data(), 1, zeros, out);
+    }
+    fclose(in);
+    return fclose(out) == 0 && ok;
+}
+
+bool backupDatabase(const string& sourcePath, const string& destPath, const BackupOptions& options) {
+    string copyPath = options.compress ? destPath + ".tmp" : destPath;
+    sqlite3* source;
+    sqlite3* dest;
+    if (sqlite3_open_v2(sourcePath.c_str(), &source, SQLITE_OPEN_READONLY, 0) != SQLITE_OK) {
+        cerr << "Can't open database: " << sqlite3_errmsg(source) << endl;
+        sqlite3_close(source);
+        return false;
+    }
+    if (sqlite3_open(copyPath.c_str(), &dest) != SQLITE_OK) {
+        cerr << "Can't open backup file: " << sqlite3_errmsg(dest) << endl;
+        sqlite3_close(dest);
+        sqlite3_close(source);
+        return false;
+    }
+
+    sqlite3_backup* backup = sqlite3_backup_init(dest, "main", source, "main");
+    if (!backup) {
+        cerr << "Backup failed: " << sqlite3_errmsg(dest) << endl;
+        sqlite3_close(dest);
+        sqlite3_close(source);
+        return false;
+    }
+
+    auto start = chrono::steady_clock::now();
+    auto lastReport = start;
+    int rc;
+    do {
+        rc = sqlite3_backup_step(backup, options.pagesPerStep);
+        auto now = chrono::steady_clock::now();
+        if (options.progress && now - lastReport >= chrono::seconds(1)) {
+            int total = sqlite3_backup_pagecount(backup);
+            int copied = total - sqlite3_backup_remaining(backup);
+            double elapsed = chrono::duration<double>(now - start).count();
+            cout << "Copied " << copied << "/" << total << " pages ("
+                << static_cast<long long>(copied / elapsed) << " pages/s)" << endl;
+            lastReport = now;
+        }
+        if ((rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED) && options.sleepMs > 0) {
+            this_thread::sleep_for(chrono::milliseconds(options.sleepMs));
+        }
+    } while (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED);
+
+    int pages = sqlite3_backup_pagecount(backup);
+    sqlite3_backup_finish(backup);
+    bool ok = rc == SQLITE_DONE;
+    if (!ok) {
+        cerr << "Backup failed: " << sqlite3_errstr(rc) << endl;
+    }
+    sqlite3_close(dest);
+    sqlite3_close(source);
+
+    if (ok && options.compress) {
+        ok = compressFile(copyPath, destPath);
+        remove(copyPath.c_str());
+        if (!ok) cerr << "Can't write compressed backup: " << destPath << endl;
+    }
+    if (ok && options.report) {
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "Backup of " << pages << " pages written to " << destPath << " in " << fixed << setprecision(2)
+            << elapsed << "s (" << static_cast<long long>(pages / max(elapsed, 0.001)) << " pages/s)" << endl;
+    }
+    return ok;
+}
+
+// Output layer: listings are emitted row by row into a ReportWriter, which
+// renders them as an aligned table, CSV or JSON (--format) into a large
+// buffer. Full buffers are handed to a background write while the next rows
+// are formatted, so big listings stream at pipe speed instead of flushing per row.
+enum class OutputFormat { Table, Csv, Json };
+OutputFormat outputFormat = OutputFormat::Table;
+
+class OutputBuffer {
+private:
+    static const size_t flushSize = 64 * 1024;
+    string buffer;
+    string writing;
+    future<void> pending;
+public:
+    ~OutputBuffer() { finish(); }
+
+    void append(const string& text) {
+        buffer += text;
+        if (buffer.size() >= flushSize) flush();
+    }
+
+    void flush() {
+        if (pending.valid()) pending.wait();
+        writing.swap(buffer);
+        buffer.clear();
+        pending = async(launch::async, [this] {
+            fwrite(writing.data(), 1, writing.size(), stdout);
+            fflush(stdout);
+        });
+    }
+
+    // Blocks until everything appended so far has been written
+    void finish() {
+        if (!buffer.empty()) flush();
+        if (pending.valid()) pending.wait();
+    }
+};
+
+string formatNumber(double value, int precision = 2) {
+    char text[64];
+    snprintf(text, sizeof(text), "%.*f", precision, value);
+    string result = text;
+    if (result.find('.') != string::npos) {
+        result.erase(result.find_last_not_of('0') + 1);
+        if (result.back() == '.') result.pop_back();
+    }
+    return result;
+}
+
+struct Column {
+    string name;
+    bool numeric = false;
+};
+
+class ReportWriter {
+private:
+    static const size_t widthSample = 256;
+    vector<Column> columns;
+    vector<size_t> widths;
+    vector<vector<string>> sample; // rows held back until column widths are known
+    bool started = false;
+    bool finished = false;
+    size_t rows = 0;
+    OutputBuffer out;
+
+    static string csvField(const string& value) {
+        if (value.find_first_of(",\"\n\r") == string::npos) return value;
+        string quoted = "\"";
+        for (char c : value) {
+            if (c == '"') quoted += '"';
+            quoted += c;
+        }
+        return quoted + "\"";
+    }
+
+    void emitTableRow(const vector<string>& values) {
+        string line;
+        for (size_t i = 0; i < values.size(); ++i) {
+            line += values[i];
+            if (i + 1 < values.size() && values[i].size() < widths[i] + 2) {
+                line.append(widths[i] + 2 - values[i].size(), ' ');
+            }
+            else if (i + 1 < values.size()) {
+                line += ' ';
+            }
+        }
+        out.append(line + "\n");
+    }
+
+    void emitHeader() {
+        started = true;
+        if (outputFormat == OutputFormat::Table) {
+            vector<string> names;
+            size_t total = 0;
+            for (size_t i = 0; i < columns.size(); ++i) {
+                names.push_back(columns[i].name);
+                total += widths[i] + 2;
+            }
+            emitTableRow(names);
+            out.append(string(total, '-') + "\n");
+        }
+        else if (outputFormat == OutputFormat::Csv) {
+            string line;
+            for (size_t i = 0; i < columns.size(); ++i) {
+                line += (i ? "," : "") + csvField(columns[i].name);
+            }
+            out.append(line + "\n");
+        }
+        else {
+            out.append("[");
+        }
+    }
+
+    void emitRow(const vector<string>& values) {
+        if (outputFormat == OutputFormat::Table) {
+            emitTableRow(values);
+        }
+        else if (outputFormat == OutputFormat::Csv) {
+            string line;
+            for (size_t i = 0; i < values.size(); ++i) {
+                line += (i ? "," : "") + csvField(values[i]);
+            }
+            out.append(line + "\n");
+        }
+        else {
+            string object = rows++ ? ",\n{" : "\n{";
+            for (size_t i = 0; i < values.size() && i < columns.size(); ++i) {
+                object += (i ? "," : "") + jsonString(columns[i].name) + ":";
+                object += columns[i].numeric && !values[i].empty() ? values[i] : jsonString(values[i]);
+            }
+            out.append(object + "}");
+        }
+    }
+
+    void releaseSample() {
+        if (!started) emitHeader();
+        for (const auto& values : sample) emitRow(values);
+        sample.clear();
+    }
+public:
+    explicit ReportWriter(vector<Column> columns) : columns(move(columns)) {
+        for (const auto& column : this->columns) widths.push_back(column.name.size());
+        cout.flush();
+    }
+    ~ReportWriter() { finish(); }
+
+    static string jsonString(const string& value) {
+        string escaped = "\"";
+        for (char c : value) {
+            switch (c) {
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\r': escaped += "\\r"; break;
+            case '\t': escaped += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char code[7];
+                    snprintf(code, sizeof(code), "\\u%04x", c);
+                    escaped += code;
+                }
+                else {
+                    escaped += c;
+                }
+            }
+        }
+        return escaped + "\"";
+    }
+
+    void row(vector<string> values) {
+        values.resize(columns.size());
+        if (outputFormat != OutputFormat::Table || started) {
+            if (!started) emitHeader();
+            emitRow(values);
+            return;
+        }
+        for (size_t i = 0; i < values.size(); ++i) {
+            widths[i] = max(widths[i], values[i].size());
+        }
+        sample.push_back(move(values));
+        if (sample.size() >= widthSample) releaseSample();
+    }
+
+    void finish() {
+        if (finished) return;
+        finished = true;
+        releaseSample();
+        if (outputFormat == OutputFormat::Json) out.append(rows ? "\n]\n" : "]\n");
+        out.finish();
+    }
+};
+
+// Audit log: who changed what. Every mutation made through the menus appends
+// a record (acting user, the student/course it concerns, before and after
+// values) to a memory-mapped, append-only segment file next to the database:
+// university.db -> university.audit.1, university.audit.2, ...
+// An append is a copy into the mapping; a background thread flushes the dirty
+// pages every auditSyncMs, so one sync covers every record written in between
+// (group commit) and the menus never wait for the disk.
+// Several processes may share the log: appends hold an exclusive lock on
+// university.audit.lock and first pick up records other processes added.
+//
+// Segment layout: "UAUD" + format byte, then records of
+//   varint length | varint seq | varint unix time | zigzag actor
+//   | zigzag student | zigzag course | action, before, after as varint length + text
+// The unwritten rest of a segment is zero, and a zero length ends the scan.
+const char auditMagic[] = { 'U', 'A', 'U', 'D', 1 };
+const int auditSyncMs = 200;
+int auditActor = 0; // user id of the logged-in session, 0 for commands
+
+struct AuditRecord {
+    unsigned long long seq = 0;
+    long long timestamp = 0;
+    int actor = 0;
+    int studentId = 0; // 0: not about one student
+    int courseId = 0;  // 0: not about one course
+    string action;
+    string before;
+    string after;
+};
+
+string encodeAudit(const AuditRecord& record) {
+    string body;
+    putVarint(body, record.seq);
+    putVarint(body, static_cast<unsigned long long>(record.timestamp));
+    putSigned(body, record.actor);
+    putSigned(body, record.studentId);
+    putSigned(body, record.courseId);
+    for (const string* text : { &record.action, &record.before, &record.after }) {
+        putVarint(body, text->size());
+        body += *text;
+    }
+    string encoded;
+    putVarint(encoded, body.size());
+    return encoded + body;
+}
+
+bool decodeAudit(const string& body, AuditRecord& record) {
+    size_t pos = 0;
+    unsigned long long timestamp;
+    long long actor, studentId, courseId;
+    if (!getVarint(body, pos, record.seq) || !getVarint(body, pos, timestamp) || !getSigned(body, pos, actor)
+        || !getSigned(body, pos, studentId) || !getSigned(body, pos, courseId)) return false;
+    record.timestamp = static_cast<long long>(timestamp);
+    record.actor = static_cast<int>(actor);
+    record.studentId = static_cast<int>(studentId);
+    record.courseId = static_cast<int>(courseId);
+    for (string* text : { &record.action, &record.before, &record.after }) {
+        unsigned long long length;
+        if (!getVarint(body, pos, length) || pos + length > body.size()) return false;
+        *text = body.substr(pos, length);
+        pos += length;
+    }
+    return true;
+}
+
+// Walks the records of a segment image from offset from (a record boundary);
+// returns the offset past the last one
+size_t scanAuditSegment(const char* data, size_t size, const function<void(const AuditRecord&)>& visit, size_t from = 0) {
+    if (size < sizeof(auditMagic) || memcmp(data, auditMagic, sizeof(auditMagic)) != 0) return 0;
+    size_t pos = max(from, sizeof(auditMagic));
+    while (pos < size && data[pos] != 0) {
+        string prefix(data + pos, min<size_t>(10, size - pos)); // a varint takes at most 10 bytes
+        size_t start = 0;
+        unsigned long long length;
+        AuditRecord record;
+        if (!getVarint(prefix, start, length) || pos + start + length > size
+            || !decodeAudit(string(data + pos + start, length), record)) {
+            return pos;
+        }
+        pos += start + length;
+        if (visit) visit(record);
+    }
+    return pos;
+}
+
+class AuditLog {
+private:
+    static const size_t segmentSize = 4 * 1024 * 1024;
+    string basePath; // segment files are basePath + ".1", ".2", ...
+    int segment = 0;
+    char* mapping = nullptr;
+    size_t used = 0;
+    size_t synced = 0;
+    unsigned long long mappingGeneration = 0;
+    unsigned long long nextSeq = 1;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE view = nullptr;
+#else
+    int file = -1;
+#endif
+    FILE* lockFileHandle = nullptr; // basePath + ".lock", locked around each append
+    mutex lock;     // segment state and appends
+    mutex syncLock; // held while flushing and while the mapping is swapped
+    condition_variable wake;
+    thread syncer;
+    bool stopping = false;
+
+    void flushRange(size_t from, size_t to) {
+        if (from >= to) return;
+#if defined(_WIN32)
+        FlushViewOfFile(mapping + from, to - from);
+        FlushFileBuffers(file);
+#else
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t start = from / page * page;
+        msync(mapping + start, to - start, MS_SYNC);
+#endif
+    }
+
+    bool mapSegment(int index) {
+        string path = segmentPath(index);
+        char* address = nullptr;
+#if defined(_WIN32)
+        HANDLE segmentFile = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+            OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (segmentFile == INVALID_HANDLE_VALUE) return false;
+        HANDLE segmentView = CreateFileMappingA(segmentFile, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(segmentSize), nullptr);
+        if (segmentView) address = static_cast<char*>(MapViewOfFile(segmentView, FILE_MAP_WRITE, 0, 0, segmentSize));
+        if (!address) {
+            if (segmentView) CloseHandle(segmentView);
+            CloseHandle(segmentFile);
+            return false;
+        }
+#else
+        int segmentFile = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (segmentFile < 0) return false;
+        struct stat info;
+        void* mapped = MAP_FAILED;
+        if (fstat(segmentFile, &info) == 0
+            && (static_cast<size_t>(info.st_size) >= segmentSize || ftruncate(segmentFile, segmentSize) == 0)) {
+            mapped = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, segmentFile, 0);
+        }
+        if (mapped == MAP_FAILED) {
+            ::close(segmentFile);
+            return false;
+        }
+        address = static_cast<char*>(mapped);
+#endif
+        {
+            // The sync thread reads these under syncLock only
+            lock_guard<mutex> publishing(syncLock);
+            file = segmentFile;
+#if defined(_WIN32)
+            view = segmentView;
+#endif
+            mapping = address;
+            segment = index;
+            ++mappingGeneration;
+        }
+        if (memcmp(mapping, auditMagic, sizeof(auditMagic)) != 0) {
+            memcpy(mapping, auditMagic, sizeof(auditMagic));
+        }
+        used = scanAuditSegment(mapping, segmentSize, [this](const AuditRecord& record) {
+            nextSeq = record.seq + 1;
+        });
+        synced = used;
+        return true;
+    }
+
+    // Flushes what is left and releases the current segment
+    void unmapSegment() {
+        lock_guard<mutex> guard(syncLock);
+        if (mapping) {
+            flushRange(synced, used);
+#if defined(_WIN32)
+            UnmapViewOfFile(mapping);
+#else
+            munmap(mapping, segmentSize);
+#endif
+        }
+#if defined(_WIN32)
+        if (view) CloseHandle(view);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        view = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (file >= 0) ::close(file);
+        file = -1;
+#endif
+        mapping = nullptr;
+        used = synced = 0;
+    }
+
+    void syncLoop() {
+        unique_lock<mutex> guard(lock);
+        while (!stopping) {
+            wake.wait_for(guard, chrono::milliseconds(auditSyncMs));
+            if (!mapping || synced == used) continue;
+            size_t from = synced, to = used;
+            unsigned long long generation = mappingGeneration;
+            guard.unlock();
+            {
+                lock_guard<mutex> flushing(syncLock);
+                if (generation == mappingGeneration) flushRange(from, to);
+            }
+            guard.lock();
+            if (generation == mappingGeneration) synced = max(synced, to);
+        }
+    }
+
+    // Called with the file lock held
+    bool appendLocked(AuditRecord& record) {
+        // Follow segments started by other processes, then past their records
+        int latest = max(1, segment);
+        while (filesystem::exists(segmentPath(latest + 1))) ++latest;
+        if (mapping && latest != segment) unmapSegment();
+        if (!mapping && !mapSegment(latest)) {
+            cerr << "Can't open audit log " << segmentPath(latest) << endl;
+            return false;
+        }
+        used = scanAuditSegment(mapping, segmentSize, [this](const AuditRecord& existing) {
+            nextSeq = existing.seq + 1;
+        }, used);
+
+        record.seq = nextSeq;
+        record.timestamp = static_cast<long long>(time(nullptr));
+        string encoded = encodeAudit(record);
+        if (encoded.size() + sizeof(auditMagic) >= segmentSize) return false;
+        // The byte after the record must stay zero to mark the end
+        if (used + encoded.size() >= segmentSize) {
+            int next = segment + 1;
+            unmapSegment();
+            if (!mapSegment(next)) return false;
+        }
+        memcpy(mapping + used, encoded.data(), encoded.size());
+        used += encoded.size();
+        ++nextSeq;
+        return true;
+    }
+public:
+    ~AuditLog() { close(); }
+
+    string segmentPath(int index) const { return basePath + "." + to_string(index); }
+    int segments() const {
+        int count = 0;
+        while (filesystem::exists(segmentPath(count + 1))) ++count;
+        return count;
+    }
+
+    // Segments are opened on the first append
+    void open(const string& databaseFile) {
+        close();
+        size_t dot = databaseFile.rfind('.');
+        basePath = (dot == string::npos ? databaseFile : databaseFile.substr(0, dot)) + ".audit";
+    }
+
+    bool append(AuditRecord record) {
+        lock_guard<mutex> guard(lock);
+        if (!lockFileHandle) lockFileHandle = openFile(basePath + ".lock", "ab");
+        if (!lockFileHandle) {
+            cerr << "Can't open audit log lock " << basePath << ".lock" << endl;
+            return false;
+        }
+        lockFile(lockFileHandle, true);
+        bool appended = appendLocked(record);
+        lockFile(lockFileHandle, false);
+        if (!appended) return false;
+        if (!syncer.joinable()) {
+            stopping = false;
+            syncer = thread(&AuditLog::syncLoop, this);
+        }
+        return true;
+    }
+
+    void close() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (syncer.joinable()) syncer.join();
+        lock_guard<mutex> guard(lock);
+        unmapSegment();
+        if (lockFileHandle) fclose(lockFileHandle);
+        lockFileHandle = nullptr;
+    }
+};
+
+AuditLog auditLog;
+
+void audit(const string& action, int studentId, int courseId, const string& before, const string& after) {
+    AuditRecord record;
+    record.actor = auditActor;
+    record.studentId = studentId;
+    record.courseId = courseId;
+    record.action = action;
+    record.before = before;
+    record.after = after;
+    auditLog.append(move(record));
+}
+
+// History for one student or course, oldest first, across all segments
+int showAuditHistory(bool byCourse, int id) {
+    map<int, string> actors;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "SELECT id, username FROM users;", -1, &stmt, 0) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            actors[sqlite3_column_int(stmt, 0)] = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    ReportWriter report({ { "Seq", true }, { "Time" }, { "Actor" }, { "Action" }, { "Student", true },
+        { "Course", true }, { "Before" }, { "After" } });
+    int count = auditLog.segments();
+    for (int index = 1; index <= count; ++index) {
+        FILE* file = openFile(auditLog.segmentPath(index), "rb");
+        if (!file) continue;
+        string image;
+        char chunk[64 * 1024];
+        size_t read;
+        while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) image.append(chunk, read);
+        fclose(file);
+        scanAuditSegment(image.data(), image.size(), [&](const AuditRecord& record) {
+            if ((byCourse ? record.courseId : record.studentId) != id) return;
+            char when[32];
+            time_t timestamp = static_cast<time_t>(record.timestamp);
+            struct tm timeinfo;
+#if defined(_WIN32) || defined(_WIN64)
+            localtime_s(&timeinfo, &timestamp);
+#else
+            localtime_r(&timestamp, &timeinfo);
+#endif
+            strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &timeinfo);
+            string actor = record.actor == 0 ? "system"
+                : actors.count(record.actor) ? actors[record.actor] : "#" + to_string(record.actor);
+            report.row({ to_string(record.seq), when, actor, record.action,
+                record.studentId ? to_string(record.studentId) : "", record.courseId ? to_string(record.courseId) : "",
+                record.before, record.after });
+        });
+    }
+    return 0;
+}
+
+// Helper function to execute SQL queries
+bool executeSQL(const char* sql) {
+    char* errMsg = 0;
+    int rc = sqlite3_exec(db, sql, 0, 0, &errMsg);
+    if (rc != SQLITE_OK) {
+        cerr << "SQL error: " << errMsg << endl;
+        sqlite3_free(errMsg);
+        return false;
+    }
+    flushChangeCapture();
+    return true;
+}
+
+// Change tracking: the update hook bumps a counter per table and per watched row,
+// so cached values can tell whether the rows they were loaded from have changed
+map<string, unsigned long long> tableVersions;
+map<pair<string, sqlite3_int64>, unsigned long long> rowVersions;
+
+void onRowChange(void*, int op, const char* database, const char* table, sqlite3_int64 rowid) {
+    // Attached archives are separate files; only the main database is logged
+    if (strcmp(database, "main") != 0) return;
+    captureChange(op, table, rowid);
+    ++tableVersions[table];
+    auto it = rowVersions.find({ table, rowid });
+    if (it != rowVersions.end()) {
+        ++it->second;
+    }
+}
+
+// Bumped whenever db is reopened, since data_version restarts with the connection
+unsigned long long connectionGeneration = 0;
+
+// Changes committed by other connections (processes) since this one opened
+unsigned long long externalVersion() {
+    unsigned long long version = connectionGeneration << 32;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "PRAGMA data_version;", -1, &stmt, 0) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        version += sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return version;
+}
+
+// A table, or a single row of it when rowid >= 0, that a cached value depends on
+struct Dependency {
+    string table;
+    sqlite3_int64 rowid;
+};
+
+// Value loaded from the database on first use and reloaded only after one of
+// its dependencies changed. Move-only, like the session that owns it.
+template <typename T>
+class Lazy {
+private:
+    function<T()> load;
+    vector<Dependency> dependencies;
+    optional<T> value;
+    unsigned long long loadedVersion = 0;
+
+    unsigned long long currentVersion() const {
+        // Counters only ever grow, so their sum changes whenever any of them does
+        unsigned long long version = externalVersion();
+        for (const auto& dep : dependencies) {
+            version += dep.rowid >= 0 ? rowVersions[{ dep.table, dep.rowid }] : tableVersions[dep.table];
+        }
+        return version;
+    }
+public:
+    Lazy(function<T()> load, vector<Dependency> dependencies)
+        : load(move(load)), dependencies(move(dependencies)) {
+        for (const auto& dep : this->dependencies) {
+            if (dep.rowid >= 0) rowVersions.emplace(make_pair(dep.table, dep.rowid), 0);
+        }
+    }
+    Lazy(Lazy&&) noexcept = default;
+    Lazy& operator=(Lazy&&) noexcept = default;
+    Lazy(const Lazy&) = delete;
+    Lazy& operator=(const Lazy&) = delete;
+
+    const T& get() {
+        unsigned long long version = currentVersion();
+        if (!value || version != loadedVersion) {
+            value = load();
+            loadedVersion = version;
+        }
+        return *value;
+    }
+};
+
+// Read-only replica mode: reports are served from a local copy of the primary
+// database that a background thread refreshes with the backup API, so report
+// queries never hold locks on the file professors write grades into
+bool replicaMode = false;
+string replicaSource;
+string replicaPath; // <source stem>.replica.<slot>.db in the current directory
+atomic<bool> replicaRefreshReady(false);
+thread replicaThread;
+
+bool openReplica() {
+    if (sqlite3_open_v2(replicaPath.c_str(), &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI, 0) != SQLITE_OK) {
+        cerr << "Can't open replica: " << sqlite3_errmsg(db) << endl;
+        return false;
+    }
+    configureConnection(db);
+    ++connectionGeneration;
+    return true;
+}
+
+bool startReplica(const string& source, int refreshSeconds) {
+    replicaMode = true;
+    replicaSource = source;
+
+    // Each process holds the lock of the first free slot for its lifetime, so
+    // replicas started from one directory (of one campus or several) never
+    // share files, and the slot of an exited process is reused
+    string stem = filesystem::path(source).stem().string();
+    for (int slot = 1; replicaPath.empty(); ++slot) {
+        string slotPath = stem + ".replica." + to_string(slot);
+        FILE* slotLock = openFile(slotPath + ".lock", "ab");
+        if (!slotLock) {
+            cerr << "Can't create replica lock: " << slotPath << ".lock" << endl;
+            return false;
+        }
+        if (lockFile(slotLock, true, false)) replicaPath = slotPath + ".db"; // left open to keep the lock
+        else fclose(slotLock);
+    }
+
+    BackupOptions options;
+    options.report = false;
+    if (!backupDatabase(replicaSource, replicaPath, options) || !openReplica()) {
+        return false;
+    }
+
+    replicaThread = thread([refreshSeconds, options] {
+        string nextPath = replicaPath + ".next";
+        while (true) {
+            this_thread::sleep_for(chrono::seconds(refreshSeconds));
+            if (!replicaRefreshReady && backupDatabase(replicaSource, nextPath, options)) {
+                replicaRefreshReady = true;
+            }
+        }
+    });
+    replicaThread.detach();
+    return true;
+}
+
+// Swaps in the latest refreshed copy; called between menu actions when no
+// statement is open on the replica connection
+void refreshReplica() {
+    if (!replicaMode || !replicaRefreshReady) return;
+
+    string nextPath = replicaPath + ".next";
+    sqlite3_close(db);
+    remove(replicaPath.c_str());
+    if (rename(nextPath.c_str(), replicaPath.c_str()) != 0) {
+        cerr << "Can't refresh replica: " << nextPath << endl;
+    }
+    openReplica();
+    replicaRefreshReady = false;
+}
+
+// Guard for operations that modify data
+bool ensureWritable() {
+    if (replicaMode) {
+        cout << "Not available on a read-only replica!" << endl;
+        return false;
+    }
+    return true;
+}
+
+// Attendance partitions: one table per half-year term (attendance_2025_2 holds
+// July-December 2025). Inserts are routed by date, date-range queries only
+// touch the terms they overlap, and finished terms can be moved into their own
+// read-only archive file that is attached only while it is queried.
+//
+// Rows store the date as a day number (days since 1970-01-01) and the status
+// as present = 0/1, which SQLite encodes in the record header alone; dates are
+// only formatted as text for display.
+struct AttendancePartition {
+    string term;
+    string table;
+    string archive; // empty while the term lives in the main database
+};
+
+string currentDate() {
+    time_t now = time(nullptr);
+    char date[11];
+    struct tm timeinfo;
+#if defined(_WIN32) || defined(_WIN64)
+    localtime_s(&timeinfo, &now);
+#else
+    localtime_r(&now, &timeinfo);
+#endif
+    strftime(date, sizeof(date), "%Y-%m-%d", &timeinfo);
+    return date;
+}
+
+bool isDate(const string& date) {
+    if (date.size() != 10 || date[4] != '-' || date[7] != '-') return false;
+    for (size_t i = 0; i < date.size(); ++i) {
+        if (i != 4 && i != 7 && !isdigit(static_cast<unsigned char>(date[i]))) return false;
+    }
+    return true;
+}
+
+// Days since 1970-01-01 for a YYYY-MM-DD date (proleptic Gregorian calendar)
+int dayNumber(const string& date) {
+    int y = stoi(date.substr(0, 4)), m = stoi(date.substr(5, 2)), d = stoi(date.substr(8, 2));
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+string formatDay(int day) {
+    day += 719468;
+    int era = (day >= 0 ? day : day - 146096) / 146097;
+    int doe = day - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    int d = doy - (153 * mp + 2) / 5 + 1;
+    int m = mp < 10 ? mp + 3 : mp - 9;
+    int y = yoe + era * 400 + (m <= 2);
+    char date[32];
+    snprintf(date, sizeof(date), "%04d-%02d-%02d", y, m, d);
+    return date;
+}
+
+string termOf(const string& date) {
+    return date.substr(0, 4) + (date.substr(5, 2) <= "06" ? "_1" : "_2");
+}
+
+bool isTerm(const string& term) {
+    return term.size() == 6 && all_of(term.begin(), term.begin() + 4, ::isdigit)
+        && term[4] == '_' && (term[5] == '1' || term[5] == '2');
+}
+
+pair<string, string> termBounds(const string& term) {
+    string year = term.substr(0, 4);
+    return term[5] == '1' ? make_pair(year + "-01-01", year + "-06-30") : make_pair(year + "-07-01", year + "-12-31");
+}
+
+string attendanceTable(const string& term) {
+    return "attendance_" + term;
+}
+
+// DDL for a partition; table may be schema-qualified. Archive files hold no
+// users or courses tables, so their partitions are created without foreign keys.
+string attendanceTableSql(const string& table, bool foreignKeys) {
+    size_t dot = table.find('.');
+    string schema = dot == string::npos ? "" : table.substr(0, dot + 1);
+    string name = table.substr(dot == string::npos ? 0 : dot + 1);
+    return "CREATE TABLE IF NOT EXISTS " + table + " ("
+        "id INTEGER PRIMARY KEY,"
+        "student_id INTEGER" + string(foreignKeys ? " REFERENCES users(id)" : "") + ","
+        "course_id INTEGER" + string(foreignKeys ? " REFERENCES courses(id)" : "") + ","
+        "day INTEGER NOT NULL,"
+        "present INTEGER NOT NULL CHECK(present IN (0, 1)));"
+        "CREATE INDEX IF NOT EXISTS " + schema + name + "_student ON " + name + "(student_id, day);";
+}
+
+// Archives are recorded by file name and live next to their database, so the
+// database directory can be moved and the CLI run from anywhere. A replica
+// is a copy elsewhere; its archives are still the primary's.
+string archiveFile(const string& name) {
+    filesystem::path path(name);
+    if (path.is_absolute()) return name;
+    const char* database = replicaMode ? replicaSource.c_str() : sqlite3_db_filename(db, "main");
+    error_code error;
+    filesystem::path directory = filesystem::absolute(database ? database : "", error).parent_path();
+    return (directory / path).generic_string();
+}
+
+vector<AttendancePartition> attendancePartitions(const string& from, const string& to) {
+    vector<AttendancePartition> partitions;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "SELECT term, archive FROM attendance_partitions ORDER BY term;", -1, &stmt, 0) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            string term = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            const unsigned char* archive = sqlite3_column_text(stmt, 1);
+            pair<string, string> bounds = termBounds(term);
+            if (bounds.second < from || bounds.first > to) continue;
+            partitions.push_back({ term, attendanceTable(term), archive ? archiveFile(reinterpret_cast<const char*>(archive)) : "" });
+        }
+    }
+    sqlite3_finalize(stmt);
+    return partitions;
+}
+
+// Calls fn with the table name of every partition overlapping [from, to], oldest first
+void forEachAttendancePartition(const string& from, const string& to, const function<void(const string&)>& fn) {
+    for (const auto& partition : attendancePartitions(from, to)) {
+        if (partition.archive.empty()) {
+            fn(partition.table);
+            continue;
+        }
+        string schema = "archive_" + partition.term;
+        string attachSql = "ATTACH DATABASE 'file:" + partition.archive + "?mode=ro' AS " + schema + ";";
+        if (!executeSQL(attachSql.c_str())) continue;
+        fn(schema + "." + partition.table);
+        executeSQL(("DETACH DATABASE " + schema + ";").c_str());
+    }
+}
+
+set<string> knownPartitions;
+
+// Creates the partition for a term on first use; archived terms take no new rows
+bool ensureAttendancePartition(const string& term) {
+    if (knownPartitions.count(term)) return true;
+
+    string checkSql = "SELECT archive FROM attendance_partitions WHERE term = '" + term + "';";
+    sqlite3_stmt* stmt;
+    bool archived = false;
+    if (sqlite3_prepare_v2(db, checkSql.c_str(), -1, &stmt, 0) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        archived = sqlite3_column_type(stmt, 0) != SQLITE_NULL;
+    }
+    sqlite3_finalize(stmt);
+    if (archived) {
+        cout << "Term " << term << " is archived and read-only!" << endl;
+        return false;
+    }
+
+    string table = attendanceTable(term);
+    string createSql = attendanceTableSql(table) +
+        "INSERT OR IGNORE INTO attendance_partitions (term) VALUES ('" + term + "');";
+    if (!executeSQL(createSql.c_str())) return false;
+    knownPartitions.insert(term);
+    return true;
+}
+
+// Moves the single attendance table of older databases into term partitions
+bool migrateLegacyAttendance() {
+    sqlite3_stmt* stmt;
+    bool legacy = false;
+    if (sqlite3_prepare_v2(db, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'attendance';", -1, &stmt, 0) == SQLITE_OK) {
+        legacy = sqlite3_step(stmt) == SQLITE_ROW;
+    }
+    sqlite3_finalize(stmt);
+    if (!legacy) return true;
+
+    set<string> terms;
+    if (sqlite3_prepare_v2(db, "SELECT DISTINCT substr(date, 1, 7) FROM attendance;", -1, &stmt, 0) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            terms.insert(termOf(string(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0))) + "-01"));
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    for (const auto& term : terms) {
+        pair<string, string> bounds = termBounds(term);
+        string copySql = "INSERT INTO " + attendanceTable(term) + " (id, student_id, course_id, day, present) "
+            "SELECT id, student_id, course_id, CAST(julianday(date) - 2440587.5 AS INTEGER), status = 'present' FROM attendance "
+            "WHERE date BETWEEN '" + bounds.first + "' AND '" + bounds.second + "';";
+        if (!ensureAttendancePartition(term) || !executeSQL(copySql.c_str())) {
+            knownPartitions.clear();
+            return false;
+        }
+    }
+    return executeSQL("DROP TABLE attendance;");
+}
+
+// Rewrites a partition still using the TEXT date/status columns into the
+// day number/present bit format
+bool convertAttendanceEncoding(sqlite3* conn, const string& table) {
+    string infoSql = "PRAGMA table_info(" + table + ");";
+    sqlite3_stmt* stmt;
+    bool textDates = false;
+    if (sqlite3_prepare_v2(conn, infoSql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            textDates = textDates || string(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1))) == "date";
+        }
+    }
+    sqlite3_finalize(stmt);
+    if (!textDates) return true;
+
+    string convertSql = "SAVEPOINT convert_attendance;"
+        "ALTER TABLE " + table + " RENAME TO " + table + "_text;"
+        "DROP INDEX IF EXISTS " + table + "_student;" +
+        attendanceTableSql(table, conn == db) +
+        "INSERT INTO " + table + " (id, student_id, course_id, day, present) "
+        "SELECT id, student_id, course_id, CAST(julianday(date) - 2440587.5 AS INTEGER), status = 'present' "
+        "FROM " + table + "_text;"
+        "DROP TABLE " + table + "_text;"
+        "RELEASE convert_attendance;";
+    char* errMsg = 0;
+    if (sqlite3_exec(conn, convertSql.c_str(), 0, 0, &errMsg) != SQLITE_OK) {
+        cerr << "Can't convert " << table << ": " << errMsg << endl;
+        sqlite3_free(errMsg);
+        sqlite3_exec(conn, "ROLLBACK TO convert_attendance; RELEASE convert_attendance;", 0, 0, 0);
+        return false;
+    }
+    return true;
+}
+
+bool migrateAttendanceEncoding() {
+    bool ok = true;
+    for (const auto& partition : attendancePartitions("0000-01-01", "9999-12-31")) {
+        if (partition.archive.empty()) {
+            ok = convertAttendanceEncoding(db, partition.table) && ok;
+            continue;
+        }
+        sqlite3* archive;
+        if (sqlite3_open_v2(partition.archive.c_str(), &archive, SQLITE_OPEN_READWRITE, 0) == SQLITE_OK
+            && (configureConnection(archive), convertAttendanceEncoding(archive, partition.table))) {
+            sqlite3_exec(archive, "VACUUM;", 0, 0, 0);
+        }
+        sqlite3_close(archive);
+    }
+    return ok;
+}
+
+// Copies a finished term into its own compacted file and drops it from the main database
+int archiveAttendanceTerm(const string& term) {
+    if (!isTerm(term) || term >= termOf(currentDate())) {
+        cerr << "Only finished terms (e.g. 2025_2) can be archived" << endl;
+        return 1;
+    }
+    vector<AttendancePartition> partitions = attendancePartitions(termBounds(term).first, termBounds(term).second);
+    if (partitions.empty() || !partitions[0].archive.empty()) {
+        cerr << "No active attendance partition for term " << term << endl;
+        return 1;
+    }
+
+    // Named after the database: campuses sharing a directory keep separate archives
+    string table = attendanceTable(term);
+    const char* database = sqlite3_db_filename(db, "main");
+    string archiveName = filesystem::path(database ? database : "").stem().string() + "." + table + ".db";
+    string archivePath = archiveFile(archiveName);
+    remove(archivePath.c_str());
+    string copySql = "ATTACH DATABASE '" + archivePath + "' AS archive;" +
+        attendanceTableSql("archive." + table, false) +
+        "INSERT INTO archive." + table + " SELECT * FROM main." + table + " ORDER BY student_id, day;"
+        "DETACH DATABASE archive;";
+    if (!executeSQL(copySql.c_str())) {
+        executeSQL("DETACH DATABASE archive;");
+        return 1;
+    }
+
+    sqlite3* archive;
+    if (sqlite3_open(archivePath.c_str(), &archive) == SQLITE_OK) {
+        configureConnection(archive);
+        sqlite3_exec(archive, "VACUUM;", 0, 0, 0);
+    }
+    sqlite3_close(archive);
+
+    string switchSql = "BEGIN;"
+        "UPDATE attendance_partitions SET archive = '" + archiveName + "' WHERE term = '" + term + "';"
+        // Row by row (not the truncate optimization) so the change log records the deletes
+        "DELETE FROM main." + table + " WHERE rowid IS NOT NULL;"
+        "DROP TABLE main." + table + ";"
+        "COMMIT;";
+    if (!executeSQL(switchSql.c_str())) {
+        executeSQL("ROLLBACK;");
+        return 1;
+    }
+    knownPartitions.erase(term);
+    cout << "Archived term " << term << " to " << archivePath << endl;
+    return 0;
+}
+
+// Asks which terms a report should cover; returns false on invalid input
+bool promptDateRange(string& from, string& to) {
+    int choice;
+    cout << "1. Current Term\n";
+    cout << "2. All Terms\n";
+    cout << "3. Date Range\n";
+    cout << "Enter choice: ";
+    cin >> choice;
+    if (choice == 1) {
+        pair<string, string> bounds = termBounds(termOf(currentDate()));
+        from = bounds.first;
+        to = bounds.second;
+    }
+    else if (choice == 2) {
+        from = "0000-01-01";
+        to = "9999-12-31";
+    }
+    else if (choice == 3) {
+        cout << "From (YYYY-MM-DD): ";
+        cin >> from;
+        cout << "To (YYYY-MM-DD): ";
+        cin >> to;
+        if (!isDate(from) || !isDate(to)) {
+            cout << "Invalid date!" << endl;
+            return false;
+        }
+    }
+    else {
+        cout << "Invalid choice!" << endl;
+        return false;
+    }
+    return true;
+}
+
+// Attendance analytics: for each (student, course) two bitsets over the
+// course's class days, one for days the student was recorded and one for days
+// present. Built once from all partitions, kept current by addAttendance and
+// rebuilt if another process changed the database. Counts and streaks are
+// word-wide popcount/AND operations instead of row scans.
+class AttendanceBitmaps {
+private:
+    struct Bits {
+        vector<uint64_t> recorded;
+        vector<uint64_t> present;
+    };
+    struct CourseDays {
+        vector<int> days; // sorted; a day's position is its bit index
+        map<int, Bits> students;
+    };
+    map<int, CourseDays> courses;
+    bool loaded = false;
+    unsigned long long loadedVersion = 0;
+
+    static void setBit(vector<uint64_t>& bits, size_t pos, bool value) {
+        if (!value && bits.size() <= pos / 64) return;
+        if (bits.size() <= pos / 64) bits.resize(pos / 64 + 1, 0);
+        if (value) bits[pos / 64] |= uint64_t(1) << (pos % 64);
+        else bits[pos / 64] &= ~(uint64_t(1) << (pos % 64));
+    }
+
+    // Makes room for a class day that sorts before existing ones. Vectors only
+    // reach a student's highest set bit; past that there is nothing to move.
+    static void insertBit(vector<uint64_t>& bits, size_t pos) {
+        if (pos / 64 >= bits.size()) return;
+        bits.push_back(0);
+        for (size_t w = bits.size() - 1; w > pos / 64; --w) {
+            bits[w] = (bits[w] << 1) | (bits[w - 1] >> 63);
+        }
+        uint64_t& word = bits[pos / 64];
+        uint64_t low = word & ((uint64_t(1) << (pos % 64)) - 1);
+        word = ((word & ~low) << 1) | low;
+    }
+
+    static int count(const vector<uint64_t>& bits) {
+        int total = 0;
+        for (uint64_t word : bits) total += popcount(word);
+        return total;
+    }
+
+    void add(int studentId, int courseId, int day, bool present) {
+        CourseDays& course = courses[courseId];
+        auto it = lower_bound(course.days.begin(), course.days.end(), day);
+        size_t pos = it - course.days.begin();
+        if (it == course.days.end() || *it != day) {
+            course.days.insert(it, day);
+            if (pos + 1 < course.days.size()) {
+                for (auto& student : course.students) {
+                    insertBit(student.second.recorded, pos);
+                    insertBit(student.second.present, pos);
+                }
+            }
+        }
+        // A later entry for the same day replaces the earlier one
+        Bits& bits = course.students[studentId];
+        setBit(bits.recorded, pos, true);
+        setBit(bits.present, pos, present);
+    }
+
+    void ensureLoaded() {
+        unsigned long long version = externalVersion();
+        if (loaded && version == loadedVersion) return;
+        courses.clear();
+        forEachAttendancePartition("0000-01-01", "9999-12-31", [this](const string& table) {
+            string sql = "SELECT student_id, course_id, day, present FROM " + table + " ORDER BY course_id, day;";
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+                while (sqlite3_step(stmt) == SQLITE_ROW) {
+                    add(sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 2), sqlite3_column_int(stmt, 3) != 0);
+                }
+            }
+            sqlite3_finalize(stmt);
+        });
+        loaded = true;
+        loadedVersion = version;
+    }
+public:
+    struct Summary {
+        int studentId;
+        int recorded;
+        int present;
+    };
+
+    void record(int studentId, int courseId, int day, bool present) {
+        if (loaded) add(studentId, courseId, day, present);
+    }
+
+    bool summary(int studentId, int courseId, Summary& result) {
+        ensureLoaded();
+        auto course = courses.find(courseId);
+        if (course == courses.end()) return false;
+        auto student = course->second.students.find(studentId);
+        if (student == course->second.students.end()) return false;
+        result = { studentId, count(student->second.recorded), count(student->second.present) };
+        return true;
+    }
+
+    int classDays(int courseId) {
+        ensureLoaded();
+        auto it = courses.find(courseId);
+        return it == courses.end() ? 0 : static_cast<int>(it->second.days.size());
+    }
+
+    vector<Summary> summaries(int courseId) {
+        ensureLoaded();
+        vector<Summary> result;
+        auto it = courses.find(courseId);
+        if (it == courses.end()) return result;
+        for (const auto& student : it->second.students) {
+            result.push_back({ student.first, count(student.second.recorded), count(student.second.present) });
+        }
+        return result;
+    }
+
+    // Students present on less than percent of the class days they were recorded for
+    vector<Summary> below(int courseId, double percent) {
+        vector<Summary> result;
+        for (const auto& summary : summaries(courseId)) {
+            if (summary.present * 100.0 < percent * summary.recorded) result.push_back(summary);
+        }
+        return result;
+    }
+
+    // Students absent on at least length consecutive class days
+    vector<int> absenceStreaks(int courseId, int length) {
+        ensureLoaded();
+        vector<int> result;
+        auto it = courses.find(courseId);
+        if (it == courses.end() || length < 1) return result;
+        for (const auto& student : it->second.students) {
+            const Bits& bits = student.second;
+            vector<uint64_t> absent(bits.recorded.size());
+            for (size_t w = 0; w < absent.size(); ++w) {
+                absent[w] = bits.recorded[w] & ~(w < bits.present.size() ? bits.present[w] : 0);
+            }
+            // Bit i of run survives k rounds only if bits i..i+k of absent are all set
+            vector<uint64_t> run = absent;
+            for (int shift = 1; shift < length; ++shift) {
+                size_t words = shift / 64, bitsShift = shift % 64;
+                for (size_t w = 0; w < run.size(); ++w) {
+                    uint64_t shifted = 0;
+                    if (w + words < absent.size()) {
+                        shifted = absent[w + words] >> bitsShift;
+                        if (bitsShift && w + words + 1 < absent.size()) shifted |= absent[w + words + 1] << (64 - bitsShift);
+                    }
+                    run[w] &= shifted;
+                }
+            }
+            if (any_of(run.begin(), run.end(), [](uint64_t word) { return word != 0; })) {
+                result.push_back(student.first);
+            }
+        }
+        return result;
+    }
+};
+
+AttendanceBitmaps attendanceBitmaps;
+
+// Grade rankings: per course, a Fenwick tree counting students per distinct
+// total (in 0.01 steps) for O(log n) rank/percentile, plus the scores in
+// descending order for O(k) top-k lists. A course is built the first time it
+// is asked about, from one index range scan of its grades; addGrades keeps it
+// current, and everything is dropped if the database changed underneath.
+class GradeRankings {
+private:
+    struct CourseRanking {
+        vector<int> buckets; // distinct totals at load time, ascending
+        vector<int> tree;    // Fenwick tree over buckets
+        map<int, double> totals; // student -> total
+        set<pair<double, int>, greater<pair<double, int>>> ordered;
+    };
+    map<int, CourseRanking> courses;
+    unsigned long long loadedVersion = 0;
+
+    static int bucketOf(double total) {
+        return static_cast<int>(lround(min(100.0, max(0.0, total)) * 100));
+    }
+
+    // Position of a total's bucket in the tree, or -1 if no loaded total had it
+    static int slotOf(const CourseRanking& course, double total) {
+        int bucket = bucketOf(total);
+        auto it = lower_bound(course.buckets.begin(), course.buckets.end(), bucket);
+        return it != course.buckets.end() && *it == bucket ? static_cast<int>(it - course.buckets.begin()) : -1;
+    }
+
+    static void adjust(vector<int>& tree, int slot, int delta) {
+        for (size_t i = slot + 1; i < tree.size(); i += i & (~i + 1)) tree[i] += delta;
+    }
+
+    // Students with a total in slots 0..slot
+    static int countUpTo(const vector<int>& tree, int slot) {
+        int count = 0;
+        for (int i = slot + 1; i > 0; i -= i & -i) count += tree[i];
+        return count;
+    }
 
-using namespace std;
+    // False when the total has no slot; the course must then be rebuilt
+    static bool assign(CourseRanking& course, int studentId, double total) {
+        int slot = slotOf(course, total);
+        if (slot < 0) return false;
+        auto it = course.totals.find(studentId);
+        if (it != course.totals.end()) {
+            adjust(course.tree, slotOf(course, it->second), -1);
+            course.ordered.erase({ it->second, studentId });
+        }
+        course.totals[studentId] = total;
+        adjust(course.tree, slot, 1);
+        course.ordered.insert({ total, studentId });
+        return true;
+    }
 
-// Global database connection
-sqlite3* db;
+    const CourseRanking* ensureLoaded(int courseId) {
+        unsigned long long version = externalVersion();
+        if (version != loadedVersion) {
+            courses.clear();
+            loadedVersion = version;
+        }
+        auto it = courses.find(courseId);
+        if (it != courses.end()) return &it->second;
 
-// Helper function to execute SQL queries
-bool executeSQL(const char* sql) {
-    char* errMsg = 0;
-    int rc = sqlite3_exec(db, sql, 0, 0, &errMsg);
-    if (rc != SQLITE_OK) {
-        cerr << "SQL error: " << errMsg << endl;
-        sqlite3_free(errMsg);
+        vector<pair<int, double>> grades;
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "SELECT student_id, total FROM grades WHERE course_id = ?;", -1, &stmt, 0) == SQLITE_OK) {
+            sqlite3_bind_int(stmt, 1, courseId);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                grades.push_back({ sqlite3_column_int(stmt, 0), sqlite3_column_double(stmt, 1) });
+            }
+        }
+        sqlite3_finalize(stmt);
+        if (grades.empty()) return nullptr;
+
+        CourseRanking& course = courses[courseId];
+        for (const auto& grade : grades) course.buckets.push_back(bucketOf(grade.second));
+        sort(course.buckets.begin(), course.buckets.end());
+        course.buckets.erase(unique(course.buckets.begin(), course.buckets.end()), course.buckets.end());
+        course.tree.assign(course.buckets.size() + 1, 0);
+        for (const auto& grade : grades) assign(course, grade.first, grade.second);
+        return &course;
+    }
+public:
+    void record(int courseId, int studentId, double total) {
+        auto it = courses.find(courseId);
+        if (it != courses.end() && !assign(it->second, studentId, total)) courses.erase(it);
+    }
+
+    // Rank 1 is the best total (ties share a rank); percentile is the share
+    // of the course scoring at or below the student
+    bool rank(int courseId, int studentId, int& rank, int& count, double& percentile) {
+        const CourseRanking* course = ensureLoaded(courseId);
+        if (!course) return false;
+        auto total = course->totals.find(studentId);
+        if (total == course->totals.end()) return false;
+        count = static_cast<int>(course->totals.size());
+        int atOrBelow = countUpTo(course->tree, slotOf(*course, total->second));
+        rank = count - atOrBelow + 1;
+        percentile = atOrBelow * 100.0 / count;
+        return true;
+    }
+
+    vector<pair<int, double>> top(int courseId, int k) {
+        vector<pair<int, double>> result;
+        const CourseRanking* course = ensureLoaded(courseId);
+        if (!course) return result;
+        for (const auto& entry : course->ordered) {
+            if (static_cast<int>(result.size()) >= k) break;
+            result.push_back({ entry.second, entry.first });
+        }
+        return result;
+    }
+};
+
+GradeRankings gradeRankings;
+
+// Per-student result cache for the student menus: the report rows behind
+// "Show Grades" and "Show Attendance" (per date range) stay in memory until
+// a professor records grades or attendance for that student, or another
+// process changes the database. Rank and percentile are looked up on every
+// view since they move with everyone else's grades.
+class StudentResults {
+public:
+    struct GradeLine {
+        int courseId;
+        vector<string> cells; // Course .. Grade
+    };
+    using AttendanceRows = vector<vector<string>>;
+private:
+    static const size_t capacity = 1024;
+    static const size_t rangesPerStudent = 8;
+    struct Entry {
+        unsigned long long lastUsed = 0;
+        optional<vector<GradeLine>> grades;
+        map<pair<string, string>, AttendanceRows> attendance; // (from, to) -> rows
+    };
+    map<int, Entry> entries;
+    unsigned long long loadedVersion = 0;
+    unsigned long long uses = 0;
+
+    Entry& entry(int studentId) {
+        unsigned long long version = externalVersion();
+        if (version != loadedVersion) {
+            entries.clear();
+            loadedVersion = version;
+        }
+        auto it = entries.find(studentId);
+        if (it == entries.end()) {
+            if (entries.size() >= capacity) {
+                entries.erase(min_element(entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+                    return a.second.lastUsed < b.second.lastUsed;
+                }));
+            }
+            it = entries.emplace(studentId, Entry()).first;
+        }
+        it->second.lastUsed = ++uses;
+        return it->second;
+    }
+public:
+    // Loaders fill in the rows and return false on error; failures aren't cached
+    const vector<GradeLine>* grades(int studentId, const function<bool(vector<GradeLine>&)>& load) {
+        Entry& cached = entry(studentId);
+        if (!cached.grades) {
+            vector<GradeLine> lines;
+            if (!load(lines)) return nullptr;
+            cached.grades = move(lines);
+        }
+        return &*cached.grades;
+    }
+
+    const AttendanceRows* attendance(int studentId, const string& from, const string& to,
+        const function<bool(AttendanceRows&)>& load) {
+        Entry& cached = entry(studentId);
+        auto it = cached.attendance.find({ from, to });
+        if (it == cached.attendance.end()) {
+            AttendanceRows rows;
+            if (!load(rows)) return nullptr;
+            if (cached.attendance.size() >= rangesPerStudent) cached.attendance.clear();
+            it = cached.attendance.emplace(make_pair(from, to), move(rows)).first;
+        }
+        return &it->second;
+    }
+
+    void invalidate(int studentId) {
+        entries.erase(studentId);
+    }
+};
+
+StudentResults studentResults;
+
+// Alert rules: each watches one metric of one source
+//   grades.total      per student and course
+//   attendance.rate   percent of class days present, per student and course
+//   fees.balance      fees due minus paid, per student
+// and fires when a newly written value compares to its threshold (value < 60
+// for a failing grade, say). Rules are indexed by (source, metric) and then
+// per comparison sorted by threshold, so each write costs a binary search
+// plus the rules that actually fire, however many rules there are. There is
+// one alert row per rule, student and course: raised when the rule fires and
+// resolved when a later value no longer does.
+class RuleEngine {
+private:
+    struct Rule {
+        double threshold;
+        int id;
+        string name;
+    };
+    map<pair<string, string>, map<string, vector<Rule>>> index; // (source, metric) -> op -> rules
+    bool loaded = false;
+    unsigned long long loadedVersion = 0;
+
+    void ensureLoaded() {
+        unsigned long long version = externalVersion();
+        if (loaded && version == loadedVersion) return;
+        index.clear();
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "SELECT id, name, source, metric, op, threshold FROM alert_rules WHERE active = 1;", -1, &stmt, 0) == SQLITE_OK) {
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                string source = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+                string metric = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+                string op = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+                index[{ source, metric }][op].push_back({ sqlite3_column_double(stmt, 5), sqlite3_column_int(stmt, 0),
+                    reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)) });
+            }
+        }
+        sqlite3_finalize(stmt);
+        for (auto& metric : index) {
+            for (auto& rules : metric.second) {
+                sort(rules.second.begin(), rules.second.end(), [](const Rule& a, const Rule& b) { return a.threshold < b.threshold; });
+            }
+        }
+        loaded = true;
+        loadedVersion = version;
+    }
+
+    vector<const Rule*> fired(const map<string, vector<Rule>>& rules, double value) {
+        vector<const Rule*> result;
+        auto byThreshold = [](const Rule& rule, double threshold) { return rule.threshold < threshold; };
+        auto aboveThreshold = [](double threshold, const Rule& rule) { return threshold < rule.threshold; };
+        for (const auto& entry : rules) {
+            const vector<Rule>& sorted = entry.second;
+            auto from = sorted.begin(), to = sorted.end();
+            // Fires when value <op> threshold
+            if (entry.first == "<") from = upper_bound(sorted.begin(), sorted.end(), value, aboveThreshold);
+            else if (entry.first == "<=") from = lower_bound(sorted.begin(), sorted.end(), value, byThreshold);
+            else if (entry.first == ">") to = lower_bound(sorted.begin(), sorted.end(), value, byThreshold);
+            else if (entry.first == ">=") to = upper_bound(sorted.begin(), sorted.end(), value, aboveThreshold);
+            for (auto it = from; it != to; ++it) result.push_back(&*it);
+        }
+        return result;
+    }
+public:
+    void invalidate() {
+        loaded = false;
+    }
+
+    // Called after a write changed a student's metric; courseId is 0 for fees
+    void evaluate(const string& source, const string& metric, int studentId, int courseId, double value, const string& student) {
+        ensureLoaded();
+        auto rules = index.find({ source, metric });
+        if (rules == index.end()) return;
+
+        string ruleIds, firedIds;
+        for (const auto& entry : rules->second) {
+            for (const Rule& rule : entry.second) ruleIds += (ruleIds.empty() ? "" : ", ") + to_string(rule.id);
+        }
+        for (const Rule* rule : fired(rules->second, value)) {
+            string raiseSql = "INSERT INTO alerts (rule_id, student_id, course_id, value, raised_at) VALUES ("
+                + to_string(rule->id) + ", " + to_string(studentId) + ", " + to_string(courseId) + ", " + to_string(value)
+                + ", datetime('now')) ON CONFLICT(rule_id, student_id, course_id) DO UPDATE SET value = excluded.value, "
+                "raised_at = CASE WHEN resolved_at IS NULL THEN raised_at ELSE excluded.raised_at END, resolved_at = NULL;";
+            if (executeSQL(raiseSql.c_str())) {
+                cout << "Alert for " << student << ": " << rule->name << " (" << metric << " " << formatNumber(value) << ")" << endl;
+            }
+            firedIds += (firedIds.empty() ? "" : ", ") + to_string(rule->id);
+        }
+        string resolveSql = "UPDATE alerts SET resolved_at = datetime('now') "
+            "WHERE student_id = " + to_string(studentId) + " AND course_id = " + to_string(courseId) + " AND resolved_at IS NULL "
+            "AND rule_id IN (" + ruleIds + ") "
+            "AND rule_id NOT IN (" + firedIds + ");";
+        executeSQL(resolveSql.c_str());
+    }
+};
+
+RuleEngine ruleEngine;
+
+// Query advisor (--advisor): a profile hook records every statement the
+// program runs, grouped by its text with literals replaced by ?, along with
+// call counts and run times. The report shows each statement's EXPLAIN QUERY
+// PLAN, flags full table scans and temporary sort B-trees, and recommends an
+// index on the columns a scanned table is filtered by. Recommendations can be
+// applied from the admin menu; each is benchmarked before and after, reads
+// against the extra cost on writes to the table, and dropped again if it
+// doesn't pay for itself.
+struct QueryProfile {
+    long long calls = 0;
+    long long totalNs = 0;
+    long long slowestNs = 0;
+    string slowest; // expanded SQL of the slowest run, used for EXPLAIN and benchmarks
+};
+
+struct IndexAdvice {
+    string table;
+    vector<string> columns;
+    string statement; // normalized query the index is for
+};
+
+bool advisorEnabled = false;
+mutex profileLock;
+map<string, QueryProfile> queryProfiles;
+thread_local bool profilePaused = false; // the advisor's own EXPLAINs and benchmarks
+
+// Replaces string and number literals with ? and runs of whitespace with one space
+string normalizeSql(const string& sql) {
+    string normalized;
+    for (size_t i = 0; i < sql.size(); ++i) {
+        char c = sql[i];
+        if (c == '\'') {
+            for (++i; i < sql.size(); ++i) {
+                if (sql[i] == '\'' && (i + 1 >= sql.size() || sql[i + 1] != '\'')) break;
+                if (sql[i] == '\'') ++i;
+            }
+            normalized += '?';
+        }
+        else if (isdigit(static_cast<unsigned char>(c)) && (normalized.empty()
+            || !(isalnum(static_cast<unsigned char>(normalized.back())) || normalized.back() == '_'))) {
+            while (i + 1 < sql.size() && (isalnum(static_cast<unsigned char>(sql[i + 1])) || sql[i + 1] == '.')) ++i;
+            normalized += '?';
+        }
+        else if (isspace(static_cast<unsigned char>(c))) {
+            if (!normalized.empty() && normalized.back() != ' ') normalized += ' ';
+        }
+        else {
+            normalized += c;
+        }
+    }
+    while (!normalized.empty() && normalized.back() == ' ') normalized.pop_back();
+    return normalized;
+}
+
+int onProfile(unsigned type, void*, void* statement, void* elapsed) {
+    if (type != SQLITE_TRACE_PROFILE || profilePaused) return 0;
+    sqlite3_stmt* stmt = static_cast<sqlite3_stmt*>(statement);
+    const char* text = sqlite3_sql(stmt);
+    if (!text) return 0;
+    long long ns = *static_cast<sqlite3_int64*>(elapsed);
+    string key = normalizeSql(text);
+    lock_guard<mutex> guard(profileLock);
+    QueryProfile& profile = queryProfiles[key];
+    ++profile.calls;
+    profile.totalNs += ns;
+    if (ns >= profile.slowestNs) {
+        profile.slowestNs = ns;
+        char* expanded = sqlite3_expanded_sql(stmt);
+        profile.slowest = expanded ? expanded : text;
+        sqlite3_free(expanded);
+    }
+    return 0;
+}
+
+bool isQuery(const string& sql) {
+    string head = sql.substr(0, 6);
+    transform(head.begin(), head.end(), head.begin(), ::toupper);
+    return head == "SELECT" || head.substr(0, 4) == "WITH";
+}
+
+vector<string> queryPlan(const string& sql) {
+    vector<string> plan;
+    string explainSql = "EXPLAIN QUERY PLAN " + sql;
+    sqlite3_stmt* stmt;
+    profilePaused = true;
+    if (sqlite3_prepare_v2(db, explainSql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            plan.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3)));
+        }
+    }
+    sqlite3_finalize(stmt);
+    profilePaused = false;
+    return plan;
+}
+
+// Names a plan scans without an index ("SCAN a" for "FROM grades AS a" gives "a")
+vector<string> fullScans(const vector<string>& plan) {
+    vector<string> scans;
+    for (const auto& step : plan) {
+        if (step.rfind("SCAN ", 0) != 0 || step.find(" USING ") != string::npos) continue;
+        string name = step.substr(5, step.find(' ', 5) == string::npos ? string::npos : step.find(' ', 5) - 5);
+        if (name != "CONSTANT") scans.push_back(name);
+    }
+    return scans;
+}
+
+vector<string> tableColumns(const string& table) {
+    vector<string> columns;
+    sqlite3_stmt* stmt;
+    string sql = "SELECT name FROM pragma_table_info('" + table + "');";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            columns.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+        }
+    }
+    sqlite3_finalize(stmt);
+    return columns;
+}
+
+// True if some index on table already leads with column
+bool leadingIndexExists(const string& table, const string& column) {
+    sqlite3_stmt* stmt;
+    string sql = "SELECT 1 FROM pragma_index_list('" + table + "') AS l "
+        "JOIN pragma_index_info(l.name) AS i WHERE i.seqno = 0 AND i.name = '" + column + "';";
+    bool exists = false;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+        exists = sqlite3_step(stmt) == SQLITE_ROW;
+    }
+    sqlite3_finalize(stmt);
+    return exists;
+}
+
+// Heuristic: index the columns compared with a literal in the WHERE clause,
+// equality comparisons first, then at most one range comparison
+optional<IndexAdvice> adviseIndex(const string& normalized, const string& scanned) {
+    // Resolve an alias from "FROM table [AS] alias" / "JOIN table [AS] alias"
+    string table = scanned;
+    static const regex source(R"((?:FROM|JOIN)\s+(\w+)(?:\s+(?:AS\s+)?(\w+))?)", regex::icase);
+    static const set<string> keywords = { "JOIN", "LEFT", "INNER", "ON", "WHERE", "ORDER", "GROUP", "LIMIT", "USING", "CROSS", "AS" };
+    for (sregex_iterator it(normalized.begin(), normalized.end(), source), end; it != end; ++it) {
+        string alias = (*it)[2].str(), upper = alias;
+        transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+        if (alias == scanned && !keywords.count(upper)) table = (*it)[1].str();
+    }
+    vector<string> columns = tableColumns(table);
+    if (columns.empty()) return nullopt;
+
+    size_t where = normalized.find(" WHERE ");
+    if (where == string::npos) return nullopt;
+    string clause = normalized.substr(where + 7);
+    static const regex comparison(R"((?:(\w+)\.)?(\w+) ?(=|<=|>=|<|>|BETWEEN|IN\b) ?\(? ?\?)", regex::icase);
+    vector<string> equal, range;
+    for (sregex_iterator it(clause.begin(), clause.end(), comparison), end; it != end; ++it) {
+        string qualifier = (*it)[1].str(), column = (*it)[2].str(), op = (*it)[3].str();
+        if (!qualifier.empty() && qualifier != scanned && qualifier != table) continue;
+        if (find(columns.begin(), columns.end(), column) == columns.end()) continue;
+        vector<string>& bucket = (op == "=" || op == "IN" || op == "in") ? equal : range;
+        if (find(bucket.begin(), bucket.end(), column) == bucket.end()) bucket.push_back(column);
+    }
+    vector<string> indexColumns = equal;
+    for (const auto& column : range) {
+        if (find(indexColumns.begin(), indexColumns.end(), column) == indexColumns.end()) {
+            indexColumns.push_back(column);
+            break;
+        }
+    }
+    if (indexColumns.empty() || leadingIndexExists(table, indexColumns[0])) return nullopt;
+    return IndexAdvice{ table, indexColumns, normalized };
+}
+
+string indexName(const IndexAdvice& advice) {
+    string name = "advisor_" + advice.table;
+    for (const auto& column : advice.columns) name += "_" + column;
+    return name;
+}
+
+// Average time of a read query over a few runs, in milliseconds
+double benchmarkQuery(const string& sql) {
+    profilePaused = true;
+    int runs = 0;
+    auto begin = chrono::steady_clock::now();
+    do {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) break;
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+        }
+        sqlite3_finalize(stmt);
+        ++runs;
+    } while (runs < 200 && chrono::steady_clock::now() - begin < chrono::milliseconds(200));
+    profilePaused = false;
+    return runs ? chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count() / runs : 0;
+}
+
+// Cost of rewriting up to 500 rows' indexed columns, per row in microseconds;
+// the updates are rolled back
+double benchmarkWrite(const IndexAdvice& advice) {
+    string assignments;
+    for (const auto& column : advice.columns) assignments += (assignments.empty() ? "" : ", ") + column + " = " + column;
+    string sql = "UPDATE " + advice.table + " SET " + assignments + " WHERE rowid IN (SELECT rowid FROM " + advice.table + " LIMIT 500);";
+    profilePaused = true;
+    executeSQL("BEGIN;");
+    auto begin = chrono::steady_clock::now();
+    bool ok = executeSQL(sql.c_str());
+    double elapsed = chrono::duration<double, micro>(chrono::steady_clock::now() - begin).count();
+    int rows = sqlite3_changes(db);
+    executeSQL("ROLLBACK;");
+    profilePaused = false;
+    return ok && rows > 0 ? elapsed / rows : 0;
+}
+
+// Writes seen by the profiler that touch table
+long long profiledWrites(const string& table) {
+    long long writes = 0;
+    lock_guard<mutex> guard(profileLock);
+    for (const auto& entry : queryProfiles) {
+        const string& sql = entry.first;
+        if (sql.find("INSERT INTO " + table + " ") != string::npos || sql.find("UPDATE " + table + " ") != string::npos
+            || sql.find("DELETE FROM " + table + " ") != string::npos) {
+            writes += entry.second.calls;
+        }
+    }
+    return writes;
+}
+
+// Prints the profile and plans; returns the index recommendations
+vector<IndexAdvice> reportQueryProfile() {
+    vector<pair<string, QueryProfile>> profiles;
+    {
+        lock_guard<mutex> guard(profileLock);
+        profiles.assign(queryProfiles.begin(), queryProfiles.end());
+    }
+    sort(profiles.begin(), profiles.end(), [](const auto& a, const auto& b) { return a.second.totalNs > b.second.totalNs; });
+
+    vector<IndexAdvice> advice;
+    set<string> advised;
+    {
+        ReportWriter report({ { "Calls", true }, { "Total ms", true }, { "Avg ms", true }, { "Flags" }, { "Statement" }, { "Plan" } });
+        for (const auto& entry : profiles) {
+            const QueryProfile& profile = entry.second;
+            vector<string> plan = isQuery(entry.first) ? queryPlan(profile.slowest) : vector<string>();
+            string flags, planText;
+            for (const auto& step : plan) {
+                planText += (planText.empty() ? "" : "; ") + step;
+                if (step.find("USE TEMP B-TREE") != string::npos && flags.find("temp b-tree") == string::npos) {
+                    flags += (flags.empty() ? "" : ", ") + string("temp b-tree");
+                }
+            }
+            for (const auto& scanned : fullScans(plan)) {
+                flags += (flags.empty() ? "" : ", ") + ("scan " + scanned);
+                optional<IndexAdvice> index = adviseIndex(entry.first, scanned);
+                if (index && advised.insert(indexName(*index)).second) {
+                    index->statement = profile.slowest;
+                    advice.push_back(*index);
+                }
+            }
+            report.row({ to_string(profile.calls), formatNumber(profile.totalNs / 1e6, 3),
+                formatNumber(profile.totalNs / 1e6 / profile.calls, 3), flags, entry.first, planText });
+        }
+    }
+
+    cout << "\nRecommended indexes:\n";
+    ReportWriter report({ { "Index" }, { "For" } });
+    for (const auto& index : advice) {
+        string columns;
+        for (const auto& column : index.columns) columns += (columns.empty() ? "" : ", ") + column;
+        report.row({ "CREATE INDEX " + indexName(index) + " ON " + index.table + "(" + columns + ")", normalizeSql(index.statement) });
+    }
+    return advice;
+}
+
+// Creates each index, keeps it only if the read time it saves over the
+// profiled calls outweighs the extra write time over the profiled writes
+void applyIndexAdvice(const vector<IndexAdvice>& advice) {
+    ReportWriter report({ { "Index" }, { "Read ms before", true }, { "Read ms after", true },
+        { "Write us/row before", true }, { "Write us/row after", true }, { "Verdict" } });
+    for (const auto& index : advice) {
+        long long calls = 0;
+        {
+            lock_guard<mutex> guard(profileLock);
+            auto profile = queryProfiles.find(normalizeSql(index.statement));
+            calls = profile == queryProfiles.end() ? 1 : profile->second.calls;
+        }
+        double readBefore = benchmarkQuery(index.statement);
+        double writeBefore = benchmarkWrite(index);
+
+        string columns;
+        for (const auto& column : index.columns) columns += (columns.empty() ? "" : ", ") + column;
+        string createSql = "CREATE INDEX IF NOT EXISTS " + indexName(index) + " ON " + index.table + "(" + columns + ");"
+            "ANALYZE " + index.table + ";";
+        profilePaused = true;
+        bool created = executeSQL(createSql.c_str());
+        profilePaused = false;
+        if (!created) continue;
+
+        double readAfter = benchmarkQuery(index.statement);
+        double writeAfter = benchmarkWrite(index);
+        double saved = (readBefore - readAfter) * calls;
+        double cost = (writeAfter - writeBefore) / 1000 * profiledWrites(index.table);
+        bool keep = saved > 0 && saved >= cost;
+        if (!keep) {
+            executeSQL(("DROP INDEX " + indexName(index) + ";").c_str());
+        }
+        report.row({ indexName(index), formatNumber(readBefore, 3), formatNumber(readAfter, 3),
+            formatNumber(writeBefore, 2), formatNumber(writeAfter, 2), keep ? "kept" : "dropped" });
+    }
+}
+
+// Refreshes planner statistics where they are stale; cheap enough to run at
+// every logout and when a connection closes
+void optimizeDatabase() {
+    if (replicaMode) return;
+    profilePaused = true;
+    executeSQL("PRAGMA analysis_limit = 1000; PRAGMA optimize;");
+    profilePaused = false;
+}
+
+// Sharding: each campus or faculty keeps its own database file and connection
+// (--shard name=path, repeatable). A session runs against the shard its user
+// lives in; admin reports fan out to every shard in parallel and merge rows.
+struct Shard {
+    string name;
+    string path;
+    sqlite3* conn = nullptr;
+};
+vector<Shard> shards;
+size_t activeShard = 0;
+
+void activateShard(size_t index) {
+    if (db == shards[index].conn) return;
+    activeShard = index;
+    db = shards[index].conn;
+    // Cached state belongs to the previous shard
+    ++connectionGeneration;
+    knownPartitions.clear();
+    switchChangeLog(shards[index].path);
+    auditLog.open(shards[index].path);
+}
+
+// Picks the shard for a login name, either "campus/username" or a plain
+// username looked up in each shard; strips the campus prefix
+bool routeToShard(string& username) {
+    size_t slash = username.find('/');
+    if (slash != string::npos) {
+        string campus = username.substr(0, slash);
+        username = username.substr(slash + 1);
+        for (size_t i = 0; i < shards.size(); ++i) {
+            if (shards[i].name == campus) {
+                activateShard(i);
+                return true;
+            }
+        }
         return false;
     }
-    return true;
+    if (shards.size() <= 1) return true;
+
+    for (size_t i = 0; i < shards.size(); ++i) {
+        sqlite3_stmt* stmt;
+        bool found = false;
+        if (sqlite3_prepare_v2(shards[i].conn, "SELECT 1 FROM users WHERE username = ?;", -1, &stmt, 0) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
+            found = sqlite3_step(stmt) == SQLITE_ROW;
+        }
+        sqlite3_finalize(stmt);
+        if (found) {
+            activateShard(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Report columns, with the shard name in front when there is more than one shard
+vector<Column> shardColumns(vector<Column> columns) {
+    if (shards.size() > 1) columns.insert(columns.begin(), { "Campus" });
+    return columns;
+}
+
+size_t shardIndex(sqlite3* conn) {
+    for (size_t i = 0; i < shards.size(); ++i) {
+        if (shards[i].conn == conn) return i;
+    }
+    return activeShard;
+}
+
+// Runs produce once per shard and writes its rows to report. With several
+// shards each runs on its own thread bound to that shard's connection, and
+// the rows are merged in shard order.
+void reportAcrossShards(ReportWriter& report, const function<void(const function<void(vector<string>)>&)>& produce) {
+    if (shards.size() <= 1) {
+        produce([&report](vector<string> row) { report.row(move(row)); });
+        return;
+    }
+
+    vector<future<vector<vector<string>>>> results;
+    for (const auto& shard : shards) {
+        sqlite3* conn = shard.conn;
+        string name = shard.name;
+        results.push_back(async(launch::async, [conn, name, &produce] {
+            db = conn;
+            vector<vector<string>> rows;
+            produce([&rows, &name](vector<string> row) {
+                row.insert(row.begin(), name);
+                rows.push_back(move(row));
+            });
+            return rows;
+        }));
+    }
+    for (auto& result : results) {
+        for (auto& row : result.get()) {
+            report.row(move(row));
+        }
+    }
 }
 
 // User base class
@@ -37,8 +2596,11 @@ protected:
     string role;
 public:
     User(int id, string username, string password, string name, string email, string role)
-        : id(id), username(username), password(password), name(name), email(email), role(role) {
+        : id(id), username(move(username)), password(move(password)), name(move(name)), email(move(email)), role(move(role)) {
     }
+    virtual ~User() = default;
+    User(const User&) = delete;
+    User& operator=(const User&) = delete;
 
     virtual void displayMenu() = 0;
     string getRole() const { return role; }
@@ -50,12 +2612,10 @@ public:
 class Student : public User {
 private:
     int departmentId;
-    double feesDue;
-    double feesPaid;
+    Lazy<string> departmentName;
+    Lazy<pair<double, double>> fees; // (due, paid)
 public:
-    Student(int id, string username, string password, string name, string email, int deptId, double due, double paid)
-        : User(id, username, password, name, email, "student"), departmentId(deptId), feesDue(due), feesPaid(paid) {
-    }
+    Student(int id, string username, string password, string name, string email, int deptId);
 
     void displayMenu() override;
     void showProfile();
@@ -67,12 +2627,10 @@ public:
 // Professor class
 class Professor : public User {
 private:
-    vector<int> departmentIds;
-    vector<int> courseIds;
+    Lazy<vector<int>> assignedDepartments;
+    Lazy<vector<int>> assignedCourses;
 public:
-    Professor(int id, string username, string password, string name, string email, vector<int> depts, vector<int> courses)
-        : User(id, username, password, name, email, "professor"), departmentIds(depts), courseIds(courses) {
-    }
+    Professor(int id, string username, string password, string name, string email);
 
     void displayMenu() override;
     void viewProfile();
@@ -85,7 +2643,7 @@ public:
 class Admin : public User {
 public:
     Admin(int id, string username, string password, string name, string email)
-        : User(id, username, password, name, email, "admin") {
+        : User(id, move(username), move(password), move(name), move(email), "admin") {
     }
 
     void displayMenu() override;
@@ -97,10 +2655,88 @@ public:
     void addCourse();
     void assignProfessor();
     void manageFees();
+    void backupDatabase();
+    void attendanceAnalytics();
+    void topStudents();
+    void auditHistory();
+    void changesSinceLastView();
+    void billing();
+    void alerts();
+    void queryAdvisor();
 };
 
+// Logged-in user; owns the User for the duration of the session
+class Session {
+private:
+    unique_ptr<User> user;
+public:
+    Session() = default;
+    explicit Session(unique_ptr<User> user) : user(move(user)) {
+        auditActor = this->user->getId();
+    }
+    ~Session() {
+        if (user) auditActor = 0;
+    }
+    Session(Session&&) noexcept = default;
+    Session& operator=(Session&&) noexcept = default;
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    explicit operator bool() const { return user != nullptr; }
+    User& operator*() const { return *user; }
+    User* operator->() const { return user.get(); }
+};
+
+// Loads a list of ids from a single-column query
+vector<int> loadIds(const string& sql) {
+    vector<int> ids;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            ids.push_back(sqlite3_column_int(stmt, 0));
+        }
+    }
+    sqlite3_finalize(stmt);
+    return ids;
+}
+
+Student::Student(int id, string username, string password, string name, string email, int deptId)
+    : User(id, move(username), move(password), move(name), move(email), "student"), departmentId(deptId),
+    departmentName([deptId] {
+        string deptName;
+        string sql = "SELECT name FROM departments WHERE id = " + to_string(deptId) + ";";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+            deptName = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+        return deptName;
+    }, { { "departments", deptId } }),
+    fees([id] {
+        pair<double, double> dueAndPaid(0.0, 0.0);
+        string sql = "SELECT fees_due, fees_paid FROM students WHERE user_id = " + to_string(id) + ";";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+            dueAndPaid.first = sqlite3_column_double(stmt, 0);
+            dueAndPaid.second = sqlite3_column_double(stmt, 1);
+        }
+        sqlite3_finalize(stmt);
+        return dueAndPaid;
+    }, { { "students", id } }) {
+}
+
+Professor::Professor(int id, string username, string password, string name, string email)
+    : User(id, move(username), move(password), move(name), move(email), "professor"),
+    assignedDepartments([id] {
+        return loadIds("SELECT department_id FROM professor_departments WHERE professor_id = " + to_string(id) + ";");
+    }, { { "professor_departments", -1 } }),
+    assignedCourses([id] {
+        return loadIds("SELECT course_id FROM professor_courses WHERE professor_id = " + to_string(id) + ";");
+    }, { { "professor_courses", -1 } }) {
+}
+
 // Login function
-User* login() {
+Session login() {
     string username, password;
     cout << "=== University Login ===\n";
     cout << "Username: ";
@@ -108,14 +2744,19 @@ User* login() {
     cout << "Password: ";
     cin >> password;
 
-    // First get basic user info
+    if (!routeToShard(username)) {
+        cout << "Invalid credentials!" << endl;
+        return Session();
+    }
+
+    // Role-specific data (fees, assignments) is loaded lazily by the session
     string sql = "SELECT id, username, password, name, email, role, department_id "
         "FROM users WHERE username = '" + username + "' AND password = '" + password + "';";
 
     sqlite3_stmt* stmt;
     if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
         cerr << "Failed to prepare statement: " << sqlite3_errmsg(db) << endl;
-        return nullptr;
+        return Session();
     }
 
     if (sqlite3_step(stmt) == SQLITE_ROW) {
@@ -128,52 +2769,20 @@ User* login() {
         sqlite3_finalize(stmt);
 
         if (role == "admin") {
-            return new Admin(id, username, password, name, email);
+            return Session(make_unique<Admin>(id, move(username), move(password), move(name), move(email)));
         }
         else if (role == "student") {
-            // Get student-specific data
-            string studentSql = "SELECT fees_due, fees_paid FROM students WHERE user_id = " + to_string(id) + ";";
-            sqlite3_stmt* studentStmt;
-            double due = 0.0, paid = 0.0;
-
-            if (sqlite3_prepare_v2(db, studentSql.c_str(), -1, &studentStmt, 0) == SQLITE_OK &&
-                sqlite3_step(studentStmt) == SQLITE_ROW) {
-                due = sqlite3_column_double(studentStmt, 0);
-                paid = sqlite3_column_double(studentStmt, 1);
-            }
-            sqlite3_finalize(studentStmt);
-
-            return new Student(id, username, password, name, email, deptId, due, paid);
+            return Session(make_unique<Student>(id, move(username), move(password), move(name), move(email), deptId));
         }
         else if (role == "professor") {
-            vector<int> depts, courses;
-            // Get professor departments
-            string deptSql = "SELECT department_id FROM professor_departments WHERE professor_id = " + to_string(id) + ";";
-            sqlite3_stmt* deptStmt;
-            if (sqlite3_prepare_v2(db, deptSql.c_str(), -1, &deptStmt, 0) == SQLITE_OK) {
-                while (sqlite3_step(deptStmt) == SQLITE_ROW) {
-                    depts.push_back(sqlite3_column_int(deptStmt, 0));
-                }
-                sqlite3_finalize(deptStmt);
-            }
-
-            // Get professor courses
-            string courseSql = "SELECT course_id FROM professor_courses WHERE professor_id = " + to_string(id) + ";";
-            sqlite3_stmt* courseStmt;
-            if (sqlite3_prepare_v2(db, courseSql.c_str(), -1, &courseStmt, 0) == SQLITE_OK) {
-                while (sqlite3_step(courseStmt) == SQLITE_ROW) {
-                    courses.push_back(sqlite3_column_int(courseStmt, 0));
-                }
-                sqlite3_finalize(courseStmt);
-            }
-
-            return new Professor(id, username, password, name, email, depts, courses);
+            return Session(make_unique<Professor>(id, move(username), move(password), move(name), move(email)));
         }
+        return Session();
     }
 
     sqlite3_finalize(stmt);
     cout << "Invalid credentials!" << endl;
-    return nullptr;
+    return Session();
 }
 
 // Student member functions
@@ -182,44 +2791,58 @@ void Student::showProfile() {
     cout << "Name: " << name << endl;
     cout << "Email: " << email << endl;
 
-    // Get department name
-    string sql = "SELECT name FROM departments WHERE id = " + to_string(departmentId) + ";";
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
-        string deptName = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+    const string& deptName = departmentName.get();
+    if (!deptName.empty()) {
         cout << "Department: " << deptName << endl;
         cout << string(23, '-') << endl;
     }
-    sqlite3_finalize(stmt);
 }
 
 void Student::showAttendance() {
     cout << "\n=== Attendance Records ===\n";
-    string sql = "SELECT courses.name, attendance.date, attendance.status "
-        "FROM attendance "
-        "JOIN courses ON attendance.course_id = courses.id "
-        "WHERE student_id = " + to_string(id) + ";";
-
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
-        cerr << "Error preparing statement: " << sqlite3_errmsg(db) << endl;
-        return;
-    }
-
-    cout << left << setw(20) << "Course" << setw(15) << "Date" << setw(10) << "Status" << endl;
-    cout << string(50, '-') << endl;
+    string from, to;
+    if (!promptDateRange(from, to)) return;
+
+    const StudentResults::AttendanceRows* rows = studentResults.attendance(id, from, to, [&](StudentResults::AttendanceRows& rows) {
+        bool ok = true;
+        forEachAttendancePartition(from, to, [&](const string& table) {
+            string sql = "SELECT courses.name, a.day, a.present "
+                "FROM " + table + " AS a "
+                "JOIN courses ON a.course_id = courses.id "
+                "WHERE student_id = " + to_string(id) + " AND a.day BETWEEN " + to_string(dayNumber(from))
+                + " AND " + to_string(dayNumber(to)) + " "
+                "ORDER BY a.day;";
+
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+                cerr << "Error preparing statement: " << sqlite3_errmsg(db) << endl;
+                ok = false;
+                return;
+            }
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        string course = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        string date = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        string status = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        cout << left << setw(20) << course << setw(15) << date << setw(10) << status << endl;
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                string course = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+                string date = formatDay(sqlite3_column_int(stmt, 1));
+                string status = sqlite3_column_int(stmt, 2) ? "present" : "absent";
+                rows.push_back({ course, date, status });
+            }
+            sqlite3_finalize(stmt);
+        });
+        return ok;
+    });
+    if (!rows) return;
+
+    ReportWriter report({ { "Course" }, { "Date" }, { "Status" } });
+    for (const auto& row : *rows) {
+        report.row(row);
     }
-    sqlite3_finalize(stmt);
 }
 
 void Student::showFees() {
     cout << "\n=== Fee Details ===\n";
+    // Reloaded only if this student's row changed, e.g. after a payment
+    double feesDue = fees.get().first;
+    double feesPaid = fees.get().second;
     cout << "Fees Due: $" << fixed << setprecision(2) << feesDue << endl;
     cout << "Fees Paid: $" << fixed << setprecision(2) << feesPaid << endl;
     cout << "Balance: $" << fixed << setprecision(2) << (feesDue - feesPaid) << endl;
@@ -228,39 +2851,58 @@ void Student::showFees() {
 
 void Student::showGrades() {
     cout << "\n=== Grade Report ===\n";
-    string sql = "SELECT courses.name, grades.assignment1, grades.assignment2, "
-        "grades.coursework, grades.final_exam, grades.total, grades.grade_letter "
-        "FROM grades "
-        "JOIN courses ON grades.course_id = courses.id "
-        "WHERE student_id = " + to_string(id) + ";";
-
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
-        cerr << "Error preparing statement: " << sqlite3_errmsg(db) << endl;
-        return;
-    }
+    const vector<StudentResults::GradeLine>* lines = studentResults.grades(id, [this](vector<StudentResults::GradeLine>& lines) {
+        string sql = "SELECT courses.name, grades.assignment1, grades.assignment2, "
+            "grades.coursework, grades.final_exam, grades.total, grades.grade_letter, grades.course_id "
+            "FROM grades "
+            "JOIN courses ON grades.course_id = courses.id "
+            "WHERE student_id = " + to_string(id) + ";";
 
-    cout << left << setw(15) << "Course" << setw(10) << "Ass1" << setw(10) << "Ass2"
-        << setw(10) << "CW" << setw(10) << "Final" << setw(10) << "Total" << setw(10) << "Grade" << endl;
-    cout << string(80, '-') << endl;
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+            cerr << "Error preparing statement: " << sqlite3_errmsg(db) << endl;
+            return false;
+        }
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        string course = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        double ass1 = sqlite3_column_double(stmt, 1);
-        double ass2 = sqlite3_column_double(stmt, 2);
-        double cw = sqlite3_column_double(stmt, 3);
-        double final = sqlite3_column_double(stmt, 4);
-        double total = sqlite3_column_double(stmt, 5);
-        string grade = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 6));
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            string course = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            double ass1 = sqlite3_column_double(stmt, 1);
+            double ass2 = sqlite3_column_double(stmt, 2);
+            double cw = sqlite3_column_double(stmt, 3);
+            double final = sqlite3_column_double(stmt, 4);
+            double total = sqlite3_column_double(stmt, 5);
+            string grade = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 6));
+            int courseId = sqlite3_column_int(stmt, 7);
+            lines.push_back({ courseId, { course, formatNumber(ass1), formatNumber(ass2), formatNumber(cw), formatNumber(final),
+                formatNumber(total), grade } });
+        }
+        sqlite3_finalize(stmt);
+        return true;
+    });
+    if (!lines) return;
+
+    ReportWriter report({ { "Course" }, { "Ass1", true }, { "Ass2", true }, { "CW", true },
+        { "Final", true }, { "Total", true }, { "Grade" }, { "Rank" }, { "Percentile", true } });
+    for (const auto& line : *lines) {
+        int rank = 0, count = 0;
+        double percentile = 0;
+        string rankText, percentileText;
+        if (gradeRankings.rank(line.courseId, id, rank, count, percentile)) {
+            rankText = to_string(rank) + "/" + to_string(count);
+            percentileText = formatNumber(percentile, 1);
+        }
 
-        cout << left << setw(15) << course << setw(10) << ass1 << setw(10) << ass2 << setw(10) << cw << setw(10) << final << setw(10) << total << setw(10) << grade << endl;
+        vector<string> cells = line.cells;
+        cells.push_back(rankText);
+        cells.push_back(percentileText);
+        report.row(cells);
     }
-    sqlite3_finalize(stmt);
 }
 
 void Student::displayMenu() {
     int choice;
     while (true) {
+        refreshReplica();
         cout << "\n=== Student Menu ===\n";
         cout << "1. Show Profile\n";
         cout << "2. Show Attendance\n";
@@ -283,6 +2925,8 @@ void Student::displayMenu() {
 
 // Professor member functions
 void Professor::viewProfile() {
+    const vector<int>& departmentIds = assignedDepartments.get();
+    const vector<int>& courseIds = assignedCourses.get();
     cout << "\n=== Professor Profile ===\n";
     cout << "Name: " << name << endl;
     cout << "Email: " << email << endl;
@@ -314,7 +2958,33 @@ void Professor::viewProfile() {
     cout << endl;
 }
 
+// Percent of a student's recorded days in a course they were present, the
+// latest entry counting for a day; false if nothing is recorded yet
+bool attendanceRate(int studentId, int courseId, double& rate) {
+    int recorded = 0, present = 0;
+    forEachAttendancePartition("0000-01-01", "9999-12-31", [&](const string& table) {
+        string sql = "SELECT COUNT(*), COALESCE(SUM(present), 0) FROM " + table + " WHERE id IN "
+            "(SELECT MAX(id) FROM " + table + " WHERE student_id = ? AND course_id = ? GROUP BY day);";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+            sqlite3_bind_int(stmt, 1, studentId);
+            sqlite3_bind_int(stmt, 2, courseId);
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                recorded += sqlite3_column_int(stmt, 0);
+                present += sqlite3_column_int(stmt, 1);
+            }
+        }
+        sqlite3_finalize(stmt);
+    });
+    if (recorded == 0) return false;
+    rate = present * 100.0 / recorded;
+    return true;
+}
+
 void Professor::addAttendance() {
+    if (!ensureWritable()) return;
+
+    const vector<int>& courseIds = assignedCourses.get();
     if (courseIds.empty()) {
         cout << "You have no courses assigned!" << endl;
         return;
@@ -361,20 +3031,14 @@ void Professor::addAttendance() {
     }
     sqlite3_finalize(stmt);
 
-    if (students.empty()) {
-        cout << "No students found for this course!" << endl;
-        return;
-    }
-
-    time_t now = time(nullptr);
-    char date[11];
-    struct tm timeinfo;
-#if defined(_WIN32) || defined(_WIN64)
-    localtime_s(&timeinfo, &now);
-#else
-    localtime_r(&now, &timeinfo);
-#endif
-    strftime(date, sizeof(date), "%Y-%m-%d", &timeinfo);
+    if (students.empty()) {
+        cout << "No students found for this course!" << endl;
+        return;
+    }
+
+    string date = currentDate();
+    if (!ensureAttendancePartition(termOf(date))) return;
+    string table = attendanceTable(termOf(date));
 
     cout << "\nEnter attendance for " << date << ":\n";
     for (auto& student : students) {
@@ -384,17 +3048,94 @@ void Professor::addAttendance() {
         status = tolower(status);
 
         if (status == 'p' || status == 'a') {
-            string statusStr = (status == 'p') ? "present" : "absent";
-            string insertSql = "INSERT INTO attendance (student_id, course_id, date, status) "
-                "VALUES (" + to_string(student.first) + ", " + to_string(courseId) + ", '"
-                + string(date) + "', '" + statusStr + "');";
-            executeSQL(insertSql.c_str());
+            string insertSql = "INSERT INTO " + table + " (student_id, course_id, day, present) "
+                "VALUES (" + to_string(student.first) + ", " + to_string(courseId) + ", "
+                + to_string(dayNumber(date)) + ", " + (status == 'p' ? "1" : "0") + ");";
+            if (executeSQL(insertSql.c_str())) {
+                attendanceBitmaps.record(student.first, courseId, dayNumber(date), status == 'p');
+                studentResults.invalidate(student.first);
+                double rate;
+                if (attendanceRate(student.first, courseId, rate)) {
+                    ruleEngine.evaluate("attendance", "rate", student.first, courseId, rate, student.second);
+                }
+                audit("attendance", student.first, courseId, "", date + (status == 'p' ? " present" : " absent"));
+            }
         }
     }
     cout << "Attendance recorded successfully!" << endl;
 }
 
+struct GradeRow {
+    long long version = -1; // -1: no row yet
+    double ass1 = 0, ass2 = 0, cw = 0, final = 0, total = 0;
+    string grade;
+};
+
+string describeGrade(double ass1, double ass2, double cw, double final, double total, const string& grade) {
+    return "ass1=" + formatNumber(ass1) + " ass2=" + formatNumber(ass2) + " cw=" + formatNumber(cw)
+        + " final=" + formatNumber(final) + " total=" + formatNumber(total) + " " + grade;
+}
+
+bool readGrade(int studentId, int courseId, GradeRow& row) {
+    sqlite3_stmt* stmt;
+    bool found = false;
+    if (sqlite3_prepare_v2(db, "SELECT version, assignment1, assignment2, coursework, final_exam, total, "
+        "COALESCE(grade_letter, '') FROM grades WHERE student_id = ? AND course_id = ?;", -1, &stmt, 0) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, studentId);
+        sqlite3_bind_int(stmt, 2, courseId);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            row.version = sqlite3_column_int64(stmt, 0);
+            row.ass1 = sqlite3_column_double(stmt, 1);
+            row.ass2 = sqlite3_column_double(stmt, 2);
+            row.cw = sqlite3_column_double(stmt, 3);
+            row.final = sqlite3_column_double(stmt, 4);
+            row.total = sqlite3_column_double(stmt, 5);
+            row.grade = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 6));
+            found = true;
+        }
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+// Inserts or updates a grade row in one statement, but only if the row is
+// still at the expected version (-1: must not exist yet). Returns
+// SQLITE_DONE on success, SQLITE_CONSTRAINT if someone else got there
+// first, or the error code
+int saveGrade(int studentId, int courseId, double ass1, double ass2, double cw, double final,
+    double total, const string& grade, long long expectedVersion) {
+    const char* sql = "INSERT INTO grades (student_id, course_id, assignment1, assignment2, coursework, "
+        "final_exam, total, grade_letter, version) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, 1) "
+        "ON CONFLICT(student_id, course_id) DO UPDATE SET assignment1 = excluded.assignment1, "
+        "assignment2 = excluded.assignment2, coursework = excluded.coursework, final_exam = excluded.final_exam, "
+        "total = excluded.total, grade_letter = excluded.grade_letter, version = grades.version + 1 "
+        "WHERE grades.version = ?9;";
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK) {
+        cerr << "Error preparing statement: " << sqlite3_errmsg(db) << endl;
+        return SQLITE_ERROR;
+    }
+    sqlite3_bind_int(stmt, 1, studentId);
+    sqlite3_bind_int(stmt, 2, courseId);
+    sqlite3_bind_double(stmt, 3, ass1);
+    sqlite3_bind_double(stmt, 4, ass2);
+    sqlite3_bind_double(stmt, 5, cw);
+    sqlite3_bind_double(stmt, 6, final);
+    sqlite3_bind_double(stmt, 7, total);
+    sqlite3_bind_text(stmt, 8, grade.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 9, expectedVersion);
+    int rc = sqlite3_step(stmt);
+    // The upsert's WHERE skipping the update means the version moved on
+    if (rc == SQLITE_DONE && sqlite3_changes(db) == 0) rc = SQLITE_CONSTRAINT;
+    sqlite3_finalize(stmt);
+    if (rc == SQLITE_DONE) flushChangeCapture();
+    return rc;
+}
+
 void Professor::addGrades() {
+    if (!ensureWritable()) return;
+
+    const vector<int>& courseIds = assignedCourses.get();
     if (courseIds.empty()) {
         cout << "You have no courses assigned!" << endl;
         return;
@@ -461,6 +3202,13 @@ void Professor::addGrades() {
         cout << "\nStudent: " << student.second << endl;
         double ass1, ass2, cw, final;
 
+        // Remember the version we showed; the write below only lands if no
+        // co-teacher has saved this row since
+        GradeRow seen;
+        if (readGrade(student.first, courseId, seen)) {
+            cout << "Current total: " << formatNumber(seen.total) << " (" << seen.grade << ")" << endl;
+        }
+
         cout << "Assignment 1 (20%): ";
         cin >> ass1;
         cout << "Assignment 2 (30%): ";
@@ -495,39 +3243,39 @@ void Professor::addGrades() {
         else if (total >= 60) grade = "Pass";
         else grade = "Fail";
 
-        // Check if grade exists
-        string checkSql = "SELECT id FROM grades WHERE student_id = " + to_string(student.first)
-            + " AND course_id = " + to_string(courseId) + ";";
-        sqlite3_stmt* checkStmt;
-        bool exists = false;
-        if (sqlite3_prepare_v2(db, checkSql.c_str(), -1, &checkStmt, 0) == SQLITE_OK && sqlite3_step(checkStmt) == SQLITE_ROW) {
-            exists = true;
-        }
-        sqlite3_finalize(checkStmt);
-
-        if (exists) {
-            string updateSql = "UPDATE grades SET assignment1 = " + to_string(ass1) +
-                ", assignment2 = " + to_string(ass2) +
-                ", coursework = " + to_string(cw) +
-                ", final_exam = " + to_string(final) +
-                ", total = " + to_string(total) +
-                ", grade_letter = '" + grade + "' " +
-                "WHERE student_id = " + to_string(student.first) +
-                " AND course_id = " + to_string(courseId) + ";";
-            executeSQL(updateSql.c_str());
-        }
-        else {
-            string insertSql = "INSERT INTO grades (student_id, course_id, assignment1, assignment2, coursework, final_exam, total, grade_letter) "
-                "VALUES (" + to_string(student.first) + ", " + to_string(courseId) + ", "
-                + to_string(ass1) + ", " + to_string(ass2) + ", " + to_string(cw) + ", "
-                + to_string(final) + ", " + to_string(total) + ", '" + grade + "');";
-            executeSQL(insertSql.c_str());
+        GradeRow before = seen;
+        while (true) {
+            int rc = saveGrade(student.first, courseId, ass1, ass2, cw, final, total, grade, before.version);
+            if (rc == SQLITE_DONE) {
+                gradeRankings.record(courseId, student.first, total);
+                studentResults.invalidate(student.first);
+                ruleEngine.evaluate("grades", "total", student.first, courseId, total, student.second);
+                audit("grade", student.first, courseId,
+                    before.version < 0 ? "" : describeGrade(before.ass1, before.ass2, before.cw, before.final, before.total, before.grade),
+                    describeGrade(ass1, ass2, cw, final, total, grade));
+                break;
+            }
+            if (rc != SQLITE_CONSTRAINT) {
+                cerr << "Grade for " << student.second << " not saved: " << sqlite3_errstr(rc) << endl;
+                break;
+            }
+
+            GradeRow current;
+            readGrade(student.first, courseId, current);
+            cout << "Another professor saved grades for " << student.second << " meanwhile (total "
+                << formatNumber(current.total) << ", " << current.grade << ")." << endl;
+            char overwrite;
+            cout << "Overwrite with your grades? (y/n): ";
+            cin >> overwrite;
+            if (tolower(overwrite) != 'y') break;
+            before = current;
         }
     }
     cout << "Grades recorded successfully!" << endl;
 }
 
 void Professor::showStudents() {
+    const vector<int>& courseIds = assignedCourses.get();
     if (courseIds.empty()) {
         cout << "You have no courses assigned!" << endl;
         return;
@@ -566,13 +3314,11 @@ void Professor::showStudents() {
     }
 
     cout << "\nStudents enrolled:\n";
-    cout << left << setw(20) << "Name" << "Student ID" << endl;
-    cout << string(30, '-') << endl;
-
+    ReportWriter report({ { "Name" }, { "Student ID", true } });
     while (sqlite3_step(stmt) == SQLITE_ROW) {
         string sname = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
         int sid = sqlite3_column_int(stmt, 1);
-        cout << left << setw(20) << sname << sid << endl;
+        report.row({ sname, to_string(sid) });
     }
     sqlite3_finalize(stmt);
 }
@@ -580,6 +3326,7 @@ void Professor::showStudents() {
 void Professor::displayMenu() {
     int choice;
     while (true) {
+        refreshReplica();
         cout << "\n=== Professor Menu ===\n";
         cout << "1. View Profile\n";
         cout << "2. Add Attendance\n";
@@ -601,7 +3348,83 @@ void Professor::displayMenu() {
 }
 
 // Admin member functions
+// Term billing: fee_schedules holds per-term charges for a whole department or
+// for a course (charged to every student of the course's department). A
+// billing run turns them into one student_bills row per student and term and
+// recomputes fees_due as the sum of a student's bills, all as a handful of
+// set-based statements in one transaction. Re-running a term replaces its
+// bills, so runs are idempotent.
+
+// Total charge per department for a term
+string termChargesSql(const string& term) {
+    return "WITH charges (department_id, amount) AS ("
+        "SELECT department_id, SUM(amount) FROM ("
+        "SELECT department_id, amount FROM fee_schedules WHERE term = '" + term + "' AND department_id IS NOT NULL "
+        "UNION ALL "
+        "SELECT courses.department_id, fee_schedules.amount FROM fee_schedules "
+        "JOIN courses ON courses.id = fee_schedules.course_id WHERE fee_schedules.term = '" + term + "') "
+        "GROUP BY department_id) ";
+}
+
+// Bills the students matching studentFilter (a condition on students) for a
+// term; must run inside a transaction
+bool billStudents(const string& term, const string& studentFilter) {
+    string billSql = termChargesSql(term) +
+        "INSERT INTO student_bills (student_id, term, amount) "
+        "SELECT students.user_id, '" + term + "', charges.amount FROM students "
+        "JOIN charges ON charges.department_id = students.department_id "
+        "WHERE " + studentFilter + " "
+        "ON CONFLICT(student_id, term) DO UPDATE SET amount = excluded.amount WHERE amount <> excluded.amount;";
+    // Departments that no longer have a schedule for the term
+    string staleSql = termChargesSql(term) +
+        "DELETE FROM student_bills WHERE term = '" + term + "' AND student_id IN ("
+        "SELECT user_id FROM students WHERE " + studentFilter + " "
+        "AND department_id NOT IN (SELECT department_id FROM charges));";
+    string dueSql = "UPDATE students SET fees_due = "
+        "COALESCE((SELECT SUM(amount) FROM student_bills WHERE student_bills.student_id = students.user_id), 0) "
+        "WHERE " + studentFilter + ";";
+    return executeSQL(billSql.c_str()) && executeSQL(staleSql.c_str()) && executeSQL(dueSql.c_str());
+}
+
+int runBilling(const string& term) {
+    if (!isTerm(term)) {
+        cerr << "Expected a term like 2025_1, got: " << term << endl;
+        return 1;
+    }
+    auto begin = chrono::steady_clock::now();
+    executeSQL("BEGIN;");
+    bool ok = billStudents(term, "1");
+    int students = 0;
+    double total = 0;
+    string summarySql = "SELECT COUNT(*), COALESCE(SUM(amount), 0) FROM student_bills WHERE term = '" + term + "';";
+    sqlite3_stmt* stmt;
+    if (ok && sqlite3_prepare_v2(db, summarySql.c_str(), -1, &stmt, 0) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        students = sqlite3_column_int(stmt, 0);
+        total = sqlite3_column_double(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+    string runSql = "INSERT INTO billing_runs (term, run_at, run_by, students, total) VALUES ('" + term + "', datetime('now'), "
+        + to_string(auditActor) + ", " + to_string(students) + ", " + to_string(total) + ") "
+        "ON CONFLICT(term) DO UPDATE SET run_at = excluded.run_at, run_by = excluded.run_by, "
+        "students = excluded.students, total = excluded.total;";
+    ok = ok && executeSQL(runSql.c_str());
+    if (!ok) {
+        executeSQL("ROLLBACK;");
+        cerr << "Billing for " << term << " failed; nothing changed" << endl;
+        return 1;
+    }
+    executeSQL("COMMIT;");
+    audit("billing", 0, 0, "", "term=" + term + " students=" + to_string(students) + " total=" + formatNumber(total));
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    cout << "Billed " << students << " students for " << term << ", total $" << fixed << setprecision(2) << total
+        << " (" << setprecision(3) << seconds << "s)" << endl;
+    return 0;
+}
+
 void Admin::manageUsers() {
+    if (!ensureWritable()) return;
+
     int choice;
     while (true) {
         cout << "\n=== User Management ===\n";
@@ -659,25 +3482,29 @@ void Admin::manageUsers() {
             string sql = "INSERT INTO users (username, password, name, email, role, department_id) "
                 "VALUES ('" + username + "', '" + password + "', '" + name + "', '"
                 + email + "', 'student', " + to_string(deptId) + ");";
-            if (executeSQL(sql.c_str())) {
-                // Get the new user ID
-                string idSql = "SELECT last_insert_rowid();";
-                sqlite3_stmt* stmt;
-                if (sqlite3_prepare_v2(db, idSql.c_str(), -1, &stmt, 0) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
-                    int userId = sqlite3_column_int(stmt, 0);
-                    string studentSql = "INSERT INTO students (user_id, department_id, fees_due, fees_paid) "
-                        "VALUES (" + to_string(userId) + ", " + to_string(deptId) + ", 5000.0, 0.0);";
-                    executeSQL(studentSql.c_str());
-                }
-                sqlite3_finalize(stmt);
-                cout << "Student created successfully!" << endl;
+            // The user and student rows are created together or not at all
+            executeSQL("BEGIN;");
+            bool ok = executeSQL(sql.c_str());
+            int userId = static_cast<int>(sqlite3_last_insert_rowid(db));
+            // Fees come from the current term's schedule for the department
+            string studentSql = "INSERT INTO students (user_id, department_id, fees_due, fees_paid) "
+                "VALUES (" + to_string(userId) + ", " + to_string(deptId) + ", 0.0, 0.0);";
+            ok = ok && executeSQL(studentSql.c_str()) && billStudents(termOf(currentDate()), "user_id = " + to_string(userId));
+            if (!ok) {
+                executeSQL("ROLLBACK;");
+                cout << "Student not created!" << endl;
+                continue;
             }
+            executeSQL("COMMIT;");
+            audit("add student", userId, 0, "", username + " (" + name + ") department=" + to_string(deptId));
+            cout << "Student created successfully!" << endl;
         }
         else if (choice == 2) {
             string sql = "INSERT INTO users (username, password, name, email, role) "
                 "VALUES ('" + username + "', '" + password + "', '" + name + "', '"
                 + email + "', 'professor');";
             if (executeSQL(sql.c_str())) {
+                audit("add professor", 0, 0, "", username + " (" + name + ") id=" + to_string(sqlite3_last_insert_rowid(db)));
                 cout << "Professor created successfully!" << endl;
             }
         }
@@ -709,27 +3536,29 @@ void Admin::listUsers() {
         return;
     }
 
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
-        cerr << "Error: " << sqlite3_errmsg(db) << endl;
-        return;
-    }
-
     cout << "\nUser List:\n";
-    cout << left << setw(5) << "ID" << setw(15) << "Username" << setw(25) << "Name" << setw(10) << "Role" << endl;
-    cout << string(60, '-') << endl;
+    ReportWriter report(shardColumns({ { "ID", true }, { "Username" }, { "Name" }, { "Role" } }));
+    reportAcrossShards(report, [&sql](const function<void(vector<string>)>& emit) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+            cerr << "Error: " << sqlite3_errmsg(db) << endl;
+            return;
+        }
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        int id = sqlite3_column_int(stmt, 0);
-        string username = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        string name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        string role = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        cout << left << setw(5) << id << setw(15) << username << setw(25) << name << setw(10) << role << endl;
-    }
-    sqlite3_finalize(stmt);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            int id = sqlite3_column_int(stmt, 0);
+            string username = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            string name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+            string role = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+            emit({ to_string(id), username, name, role });
+        }
+        sqlite3_finalize(stmt);
+    });
 }
 
 void Admin::addDepartment() {
+    if (!ensureWritable()) return;
+
     string name;
     cout << "\n=== Add Department ===\n";
     cout << "Department Name: ";
@@ -738,6 +3567,7 @@ void Admin::addDepartment() {
 
     string sql = "INSERT INTO departments (name) VALUES ('" + name + "');";
     if (executeSQL(sql.c_str())) {
+        audit("add department", 0, 0, "", name + " id=" + to_string(sqlite3_last_insert_rowid(db)));
         cout << "Department added successfully!" << endl;
     }
 }
@@ -750,65 +3580,184 @@ void Admin::showGrades() {
         "JOIN users ON grades.student_id = users.id "
         "JOIN courses ON grades.course_id = courses.id;";
 
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
-        cerr << "Error: " << sqlite3_errmsg(db) << endl;
-        return;
-    }
-
-    cout << left << setw(15) << "Student" << setw(15) << "Course" << setw(10) << "Ass1" << setw(10) << "Ass2"
-        << setw(10) << "CW" << setw(10) << "Final" << setw(10) << "Total" << setw(10) << "Grade" << endl;
-    cout << string(95, '-') << endl;
+    ReportWriter report(shardColumns({ { "Student" }, { "Course" }, { "Ass1", true }, { "Ass2", true }, { "CW", true },
+        { "Final", true }, { "Total", true }, { "Grade" } }));
+    reportAcrossShards(report, [&sql](const function<void(vector<string>)>& emit) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+            cerr << "Error: " << sqlite3_errmsg(db) << endl;
+            return;
+        }
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        string student = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        string course = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        double ass1 = sqlite3_column_double(stmt, 2);
-        double ass2 = sqlite3_column_double(stmt, 3);
-        double cw = sqlite3_column_double(stmt, 4);
-        double final = sqlite3_column_double(stmt, 5);
-        double total = sqlite3_column_double(stmt, 6);
-        string grade = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 7));
-
-        cout << left << setw(15) << student
-            << setw(15) << course
-            << setw(10) << ass1
-            << setw(10) << ass2
-            << setw(10) << cw
-            << setw(10) << final
-            << setw(10) << total
-            << setw(10) << grade << endl;
-    }
-    sqlite3_finalize(stmt);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            string student = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            string course = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            double ass1 = sqlite3_column_double(stmt, 2);
+            double ass2 = sqlite3_column_double(stmt, 3);
+            double cw = sqlite3_column_double(stmt, 4);
+            double final = sqlite3_column_double(stmt, 5);
+            double total = sqlite3_column_double(stmt, 6);
+            string grade = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 7));
+
+            emit({ student, course, formatNumber(ass1), formatNumber(ass2), formatNumber(cw),
+                formatNumber(final), formatNumber(total), grade });
+        }
+        sqlite3_finalize(stmt);
+    });
 }
 
 void Admin::showAttendance() {
     cout << "\n=== All Attendance ===\n";
-    string sql = "SELECT users.name, courses.name, attendance.date, attendance.status "
-        "FROM attendance "
-        "JOIN users ON attendance.student_id = users.id "
-        "JOIN courses ON attendance.course_id = courses.id;";
+    string from, to;
+    if (!promptDateRange(from, to)) return;
+
+    ReportWriter report(shardColumns({ { "Student" }, { "Course" }, { "Date" }, { "Status" } }));
+    reportAcrossShards(report, [&from, &to](const function<void(vector<string>)>& emit) {
+        forEachAttendancePartition(from, to, [&](const string& table) {
+            string sql = "SELECT users.name, courses.name, a.day, a.present "
+                "FROM " + table + " AS a "
+                "JOIN users ON a.student_id = users.id "
+                "JOIN courses ON a.course_id = courses.id "
+                "WHERE a.day BETWEEN " + to_string(dayNumber(from)) + " AND " + to_string(dayNumber(to)) + ";";
+
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+                cerr << "Error: " << sqlite3_errmsg(db) << endl;
+                return;
+            }
 
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                string student = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+                string course = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+                string date = formatDay(sqlite3_column_int(stmt, 2));
+                string status = sqlite3_column_int(stmt, 3) ? "present" : "absent";
+                emit({ student, course, date, status });
+            }
+            sqlite3_finalize(stmt);
+        });
+    });
+}
+
+// Delta reports: grades carry a change_seq that triggers bump on every insert
+// or update, and attendance rows are never updated, so rowids mark progress
+// per partition. Each admin's watermarks live in report_watermarks, per shard;
+// both queries are index range scans past the watermark, so the cost follows
+// the number of new rows. Only this view moves the watermarks.
+void Admin::changesSinceLastView() {
+    cout << "\n=== Changes Since Last View ===\n";
+    map<pair<string, string>, long long> marks; // (shard, source) -> mark
+    string markSql = "SELECT shard, source, mark FROM report_watermarks WHERE admin_id = " + to_string(id) + ";";
     sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
-        cerr << "Error: " << sqlite3_errmsg(db) << endl;
-        return;
+    if (sqlite3_prepare_v2(db, markSql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            marks[{ reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)), reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)) }]
+                = sqlite3_column_int64(stmt, 2);
+        }
     }
+    sqlite3_finalize(stmt);
+    // A replica opens no shards; it reads the marks of an unsharded primary
+    auto shardName = [](size_t shard) { return shards.empty() ? string("main") : shards[shard].name; };
+    auto markOf = [&marks, &shardName](size_t shard, const string& source, long long unseen) {
+        auto it = marks.find({ shardName(shard), source });
+        return it == marks.end() ? unseen : it->second;
+    };
+
+    // New watermarks, one map per shard so the shard workers don't share one
+    vector<map<string, long long>> reached(max<size_t>(1, shards.size()));
+
+    cout << "\nNew or updated grades:\n";
+    {
+        ReportWriter report(shardColumns({ { "Student" }, { "Course" }, { "Ass1", true }, { "Ass2", true }, { "CW", true },
+            { "Final", true }, { "Total", true }, { "Grade" } }));
+        reportAcrossShards(report, [&](const function<void(vector<string>)>& emit) {
+            size_t shard = shardIndex(db);
+            // Rows from before change tracking have change_seq 0
+            long long mark = markOf(shard, "grades", -1);
+            string sql = "SELECT users.name, courses.name, grades.assignment1, grades.assignment2, "
+                "grades.coursework, grades.final_exam, grades.total, grades.grade_letter, grades.change_seq "
+                "FROM grades "
+                "JOIN users ON grades.student_id = users.id "
+                "JOIN courses ON grades.course_id = courses.id "
+                "WHERE grades.change_seq > " + to_string(mark) + " "
+                "ORDER BY grades.change_seq;";
+
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+                cerr << "Error: " << sqlite3_errmsg(db) << endl;
+                return;
+            }
 
-    cout << left << setw(20) << "Student" << setw(20) << "Course" << setw(15) << "Date" << setw(10) << "Status" << endl;
-    cout << string(70, '-') << endl;
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                string student = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+                string course = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+                double ass1 = sqlite3_column_double(stmt, 2);
+                double ass2 = sqlite3_column_double(stmt, 3);
+                double cw = sqlite3_column_double(stmt, 4);
+                double final = sqlite3_column_double(stmt, 5);
+                double total = sqlite3_column_double(stmt, 6);
+                string grade = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 7));
+                mark = max(mark, sqlite3_column_int64(stmt, 8));
+
+                emit({ student, course, formatNumber(ass1), formatNumber(ass2), formatNumber(cw),
+                    formatNumber(final), formatNumber(total), grade });
+            }
+            sqlite3_finalize(stmt);
+            reached[shard]["grades"] = mark;
+        });
+    }
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        string student = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        string course = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        string date = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        string status = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        cout << left << setw(20) << student << setw(20) << course << setw(15) << date << setw(10) << status << endl;
+    cout << "\nNew attendance:\n";
+    {
+        ReportWriter report(shardColumns({ { "Student" }, { "Course" }, { "Date" }, { "Status" } }));
+        reportAcrossShards(report, [&](const function<void(vector<string>)>& emit) {
+            size_t shard = shardIndex(db);
+            // Archived terms take no new rows
+            for (const auto& partition : attendancePartitions("0000-01-01", "9999-12-31")) {
+                if (!partition.archive.empty()) continue;
+                long long mark = markOf(shard, partition.table, 0);
+                string sql = "SELECT users.name, courses.name, a.day, a.present, a.id "
+                    "FROM " + partition.table + " AS a "
+                    "JOIN users ON a.student_id = users.id "
+                    "JOIN courses ON a.course_id = courses.id "
+                    "WHERE a.id > " + to_string(mark) + " "
+                    "ORDER BY a.id;";
+
+                sqlite3_stmt* stmt;
+                if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+                    cerr << "Error: " << sqlite3_errmsg(db) << endl;
+                    continue;
+                }
+
+                while (sqlite3_step(stmt) == SQLITE_ROW) {
+                    string student = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+                    string course = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+                    string date = formatDay(sqlite3_column_int(stmt, 2));
+                    string status = sqlite3_column_int(stmt, 3) ? "present" : "absent";
+                    mark = max(mark, sqlite3_column_int64(stmt, 4));
+                    emit({ student, course, date, status });
+                }
+                sqlite3_finalize(stmt);
+                reached[shard][partition.table] = mark;
+            }
+        });
     }
-    sqlite3_finalize(stmt);
+
+    if (replicaMode) return; // the replica is read-only; nothing to remember
+    executeSQL("BEGIN;");
+    for (size_t shard = 0; shard < shards.size(); ++shard) {
+        for (const auto& mark : reached[shard]) {
+            string saveSql = "INSERT INTO report_watermarks (admin_id, shard, source, mark) VALUES ("
+                + to_string(id) + ", '" + shardName(shard) + "', '" + mark.first + "', " + to_string(mark.second) + ") "
+                "ON CONFLICT(admin_id, shard, source) DO UPDATE SET mark = excluded.mark;";
+            executeSQL(saveSql.c_str());
+        }
+    }
+    executeSQL("COMMIT;");
 }
 
 void Admin::addCourse() {
+    if (!ensureWritable()) return;
+
     cout << "\n=== Add Course ===\n";
 
     // List departments
@@ -850,11 +3799,15 @@ void Admin::addCourse() {
     string sql = "INSERT INTO courses (name, department_id, course_type) "
         "VALUES ('" + name + "', " + to_string(deptId) + ", '" + courseType + "');";
     if (executeSQL(sql.c_str())) {
+        audit("add course", 0, static_cast<int>(sqlite3_last_insert_rowid(db)), "",
+            name + " (" + courseType + ") department=" + to_string(deptId));
         cout << "Course added successfully!" << endl;
     }
 }
 
 void Admin::assignProfessor() {
+    if (!ensureWritable()) return;
+
     cout << "\n=== Assign Professor ===\n";
 
     // List professors
@@ -894,121 +3847,496 @@ void Admin::assignProfessor() {
             cout << id << ". " << name << endl;
         }
     }
-    sqlite3_finalize(deptStmt);
+    sqlite3_finalize(deptStmt);
+
+    if (departments.empty()) {
+        cout << "No departments found!" << endl;
+        return;
+    }
+
+    int deptId;
+    cout << "Select Department ID: ";
+    cin >> deptId;
+
+    // Assign to department
+    string deptAssignSql = "INSERT OR IGNORE INTO professor_departments (professor_id, department_id) "
+        "VALUES (" + to_string(profId) + ", " + to_string(deptId) + ");";
+    if (executeSQL(deptAssignSql.c_str()) && sqlite3_changes(db) > 0) {
+        audit("assign department", 0, 0, "", "professor=" + to_string(profId) + " department=" + to_string(deptId));
+    }
+
+    // List courses in department
+    string courseSql = "SELECT id, name FROM courses WHERE department_id = " + to_string(deptId) + ";";
+    sqlite3_stmt* courseStmt;
+    vector<pair<int, string>> courses;
+
+    if (sqlite3_prepare_v2(db, courseSql.c_str(), -1, &courseStmt, 0) == SQLITE_OK) {
+        while (sqlite3_step(courseStmt) == SQLITE_ROW) {
+            int id = sqlite3_column_int(courseStmt, 0);
+            string name = reinterpret_cast<const char*>(sqlite3_column_text(courseStmt, 1));
+            courses.push_back({ id, name });
+            cout << id << ". " << name << endl;
+        }
+    }
+    sqlite3_finalize(courseStmt);
+
+    if (courses.empty()) {
+        cout << "No courses found in this department!" << endl;
+        return;
+    }
+
+    int courseId;
+    cout << "Select Course ID: ";
+    cin >> courseId;
+
+    // Assign to course
+    string courseAssignSql = "INSERT OR IGNORE INTO professor_courses (professor_id, course_id) "
+        "VALUES (" + to_string(profId) + ", " + to_string(courseId) + ");";
+    if (executeSQL(courseAssignSql.c_str())) {
+        if (sqlite3_changes(db) > 0) audit("assign professor", 0, courseId, "", "professor=" + to_string(profId));
+        cout << "Professor assigned successfully!" << endl;
+    }
+}
+
+void Admin::manageFees() {
+    if (!ensureWritable()) return;
+
+    cout << "\n=== Manage Student Fees ===\n";
+
+    // List students
+    string sql = "SELECT users.id, users.name, students.fees_due, students.fees_paid "
+        "FROM users JOIN students ON users.id = students.user_id;";
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+        cerr << "Error: " << sqlite3_errmsg(db) << endl;
+        return;
+    }
+
+    vector<pair<int, pair<double, double>>> students; // id -> (due, paid)
+    ReportWriter report({ { "ID", true }, { "Name" }, { "Due", true }, { "Paid", true } });
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int id = sqlite3_column_int(stmt, 0);
+        string name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        double due = sqlite3_column_double(stmt, 2);
+        double paid = sqlite3_column_double(stmt, 3);
+        students.push_back({ id, {due, paid} });
+        report.row({ to_string(id), name, formatNumber(due), formatNumber(paid) });
+    }
+    sqlite3_finalize(stmt);
+    report.finish();
+
+    if (students.empty()) {
+        cout << "No students found!" << endl;
+        return;
+    }
+
+    int studentId;
+    double amount;
+    cout << "Enter Student ID to update fees: ";
+    cin >> studentId;
+    cout << "Enter payment amount: ";
+    cin >> amount;
+
+    auto it = find_if(students.begin(), students.end(),
+        [studentId](const pair<int, pair<double, double>>& s) { return s.first == studentId; });
+
+    if (it == students.end()) {
+        cout << "Invalid student ID!" << endl;
+        return;
+    }
+
+    double newPaid = it->second.second + amount;
+    double due = it->second.first;
+
+    if (newPaid > due) {
+        cout << "Payment exceeds due amount! Maximum payable: $" << (due - it->second.second) << endl;
+        return;
+    }
+
+    string updateSql = "UPDATE students SET fees_paid = " + to_string(newPaid) +
+        " WHERE user_id = " + to_string(studentId) + ";";
+    if (executeSQL(updateSql.c_str())) {
+        audit("fees", studentId, 0, "paid=" + formatNumber(it->second.second), "paid=" + formatNumber(newPaid));
+        ruleEngine.evaluate("fees", "balance", studentId, 0, due - newPaid, "student #" + to_string(studentId));
+        cout << "Fees updated successfully!" << endl;
+    }
+}
+
+void Admin::billing() {
+    while (true) {
+        cout << "\n=== Term Billing ===\n";
+        cout << "1. Add Fee Schedule\n";
+        cout << "2. List Fee Schedules\n";
+        cout << "3. Bill a Term\n";
+        cout << "4. Back\n";
+        cout << "Enter choice: ";
+        int choice;
+        cin >> choice;
+        if (choice == 4) return;
+
+        if (choice == 1) {
+            if (!ensureWritable()) continue;
+            string term;
+            cout << "Term (e.g. " << termOf(currentDate()) << "): ";
+            cin >> term;
+            if (!isTerm(term)) {
+                cout << "Invalid term!" << endl;
+                continue;
+            }
+            int scope, targetId;
+            double amount;
+            cout << "1. Department fee\n";
+            cout << "2. Course fee\n";
+            cout << "Enter choice: ";
+            cin >> scope;
+            if (scope != 1 && scope != 2) {
+                cout << "Invalid choice!" << endl;
+                continue;
+            }
+            cout << (scope == 1 ? "Department ID: " : "Course ID: ");
+            cin >> targetId;
+            cout << "Amount: ";
+            cin >> amount;
+            if (amount < 0) {
+                cout << "Invalid amount!" << endl;
+                continue;
+            }
+            string sql = "INSERT INTO fee_schedules (term, department_id, course_id, amount) VALUES ('" + term + "', "
+                + (scope == 1 ? to_string(targetId) + ", NULL" : "NULL, " + to_string(targetId)) + ", " + to_string(amount) + ");";
+            if (executeSQL(sql.c_str())) {
+                audit("fee schedule", 0, scope == 2 ? targetId : 0, "",
+                    term + (scope == 1 ? " department=" : " course=") + to_string(targetId) + " amount=" + formatNumber(amount));
+                cout << "Fee schedule added; bill the term to apply it." << endl;
+            }
+        }
+        else if (choice == 2) {
+            string sql = "SELECT fee_schedules.term, COALESCE(departments.name, ''), COALESCE(courses.name, ''), fee_schedules.amount "
+                "FROM fee_schedules "
+                "LEFT JOIN departments ON fee_schedules.department_id = departments.id "
+                "LEFT JOIN courses ON fee_schedules.course_id = courses.id "
+                "ORDER BY fee_schedules.term, fee_schedules.id;";
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+                cerr << "Error: " << sqlite3_errmsg(db) << endl;
+                continue;
+            }
+            ReportWriter report({ { "Term" }, { "Department" }, { "Course" }, { "Amount", true } });
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                report.row({ reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)),
+                    reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                    reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2)),
+                    formatNumber(sqlite3_column_double(stmt, 3)) });
+            }
+            sqlite3_finalize(stmt);
+        }
+        else if (choice == 3) {
+            if (!ensureWritable()) continue;
+            string term;
+            cout << "Term (e.g. " << termOf(currentDate()) << "): ";
+            cin >> term;
+            runBilling(term);
+        }
+        else {
+            cout << "Invalid choice!" << endl;
+        }
+    }
+}
+
+void Admin::alerts() {
+    while (true) {
+        cout << "\n=== Alerts ===\n";
+        cout << "1. Add Rule\n";
+        cout << "2. List Rules\n";
+        cout << "3. Disable Rule\n";
+        cout << "4. Open Alerts\n";
+        cout << "5. Back\n";
+        cout << "Enter choice: ";
+        int choice;
+        cin >> choice;
+        if (choice == 5) return;
+
+        if (choice == 1) {
+            if (!ensureWritable()) continue;
+            string name, op;
+            int watch;
+            double threshold;
+            cout << "Rule Name: ";
+            cin.ignore();
+            getline(cin, name);
+            cout << "1. Grade total (per course)\n";
+            cout << "2. Attendance rate % (per course)\n";
+            cout << "3. Fee balance\n";
+            cout << "Watch: ";
+            cin >> watch;
+            if (watch < 1 || watch > 3) {
+                cout << "Invalid choice!" << endl;
+                continue;
+            }
+            cout << "Fire when value is (<, <=, >, >=): ";
+            cin >> op;
+            if (op != "<" && op != "<=" && op != ">" && op != ">=") {
+                cout << "Invalid comparison!" << endl;
+                continue;
+            }
+            cout << "Threshold: ";
+            cin >> threshold;
+            const char* sources[] = { "grades", "attendance", "fees" };
+            const char* metrics[] = { "total", "rate", "balance" };
+            string sql = "INSERT INTO alert_rules (name, source, metric, op, threshold) VALUES ('" + name + "', '"
+                + sources[watch - 1] + "', '" + metrics[watch - 1] + "', '" + op + "', " + to_string(threshold) + ");";
+            if (executeSQL(sql.c_str())) {
+                ruleEngine.invalidate();
+                cout << "Rule added; it applies from the next write." << endl;
+            }
+        }
+        else if (choice == 2) {
+            ReportWriter report({ { "ID", true }, { "Name" }, { "Watches" }, { "Fires When" }, { "Active" } });
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(db, "SELECT id, name, source || '.' || metric, op, threshold, active FROM alert_rules ORDER BY id;", -1, &stmt, 0) == SQLITE_OK) {
+                while (sqlite3_step(stmt) == SQLITE_ROW) {
+                    report.row({ to_string(sqlite3_column_int(stmt, 0)), reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                        reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2)),
+                        string(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3))) + " " + formatNumber(sqlite3_column_double(stmt, 4)),
+                        sqlite3_column_int(stmt, 5) ? "yes" : "no" });
+                }
+            }
+            sqlite3_finalize(stmt);
+        }
+        else if (choice == 3) {
+            if (!ensureWritable()) continue;
+            int ruleId;
+            cout << "Rule ID: ";
+            cin >> ruleId;
+            string sql = "UPDATE alert_rules SET active = 0 WHERE id = " + to_string(ruleId) + ";";
+            if (executeSQL(sql.c_str()) && sqlite3_changes(db) > 0) {
+                ruleEngine.invalidate();
+                cout << "Rule disabled." << endl;
+            }
+            else {
+                cout << "Invalid rule ID!" << endl;
+            }
+        }
+        else if (choice == 4) {
+            string sql = "SELECT alerts.raised_at, users.name, COALESCE(courses.name, ''), alert_rules.name, alerts.value "
+                "FROM alerts "
+                "JOIN alert_rules ON alerts.rule_id = alert_rules.id "
+                "JOIN users ON alerts.student_id = users.id "
+                "LEFT JOIN courses ON alerts.course_id = courses.id "
+                "WHERE alerts.resolved_at IS NULL AND alert_rules.active = 1 "
+                "ORDER BY alerts.raised_at;";
+            ReportWriter report(shardColumns({ { "Raised" }, { "Student" }, { "Course" }, { "Rule" }, { "Value", true } }));
+            reportAcrossShards(report, [&sql](const function<void(vector<string>)>& emit) {
+                sqlite3_stmt* stmt;
+                if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+                    cerr << "Error: " << sqlite3_errmsg(db) << endl;
+                    return;
+                }
+                while (sqlite3_step(stmt) == SQLITE_ROW) {
+                    emit({ reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)), reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                        reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2)), reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3)),
+                        formatNumber(sqlite3_column_double(stmt, 4)) });
+                }
+                sqlite3_finalize(stmt);
+            });
+        }
+        else {
+            cout << "Invalid choice!" << endl;
+        }
+    }
+}
 
-    if (departments.empty()) {
-        cout << "No departments found!" << endl;
+void Admin::queryAdvisor() {
+    cout << "\n=== Query Advisor ===\n";
+    if (!advisorEnabled) {
+        cout << "Start the program with --advisor to profile queries." << endl;
         return;
     }
+    vector<IndexAdvice> advice = reportQueryProfile();
+    if (advice.empty() || replicaMode) return;
 
-    int deptId;
-    cout << "Select Department ID: ";
-    cin >> deptId;
-
-    // Assign to department
-    string deptAssignSql = "INSERT OR IGNORE INTO professor_departments (professor_id, department_id) "
-        "VALUES (" + to_string(profId) + ", " + to_string(deptId) + ");";
-    executeSQL(deptAssignSql.c_str());
+    char apply;
+    cout << "Apply and benchmark these indexes? (y/n): ";
+    cin >> apply;
+    if (tolower(apply) == 'y') applyIndexAdvice(advice);
+}
 
-    // List courses in department
-    string courseSql = "SELECT id, name FROM courses WHERE department_id = " + to_string(deptId) + ";";
+// Lists all courses and reads a course ID; returns false on invalid input
+bool selectCourse(int& courseId, string& courseName) {
+    string courseSql = "SELECT id, name FROM courses;";
     sqlite3_stmt* courseStmt;
-    vector<pair<int, string>> courses;
-
+    map<int, string> courses;
     if (sqlite3_prepare_v2(db, courseSql.c_str(), -1, &courseStmt, 0) == SQLITE_OK) {
         while (sqlite3_step(courseStmt) == SQLITE_ROW) {
             int id = sqlite3_column_int(courseStmt, 0);
             string name = reinterpret_cast<const char*>(sqlite3_column_text(courseStmt, 1));
-            courses.push_back({ id, name });
+            courses[id] = name;
             cout << id << ". " << name << endl;
         }
     }
     sqlite3_finalize(courseStmt);
 
     if (courses.empty()) {
-        cout << "No courses found in this department!" << endl;
-        return;
+        cout << "No courses found!" << endl;
+        return false;
     }
 
-    int courseId;
     cout << "Select Course ID: ";
     cin >> courseId;
+    if (!courses.count(courseId)) {
+        cout << "Invalid course ID!" << endl;
+        return false;
+    }
+    courseName = courses[courseId];
+    return true;
+}
 
-    // Assign to course
-    string courseAssignSql = "INSERT OR IGNORE INTO professor_courses (professor_id, course_id) "
-        "VALUES (" + to_string(profId) + ", " + to_string(courseId) + ");";
-    if (executeSQL(courseAssignSql.c_str())) {
-        cout << "Professor assigned successfully!" << endl;
+// Resolves student names for results computed from in-memory structures
+map<int, string> studentNames() {
+    map<int, string> names;
+    sqlite3_stmt* nameStmt;
+    if (sqlite3_prepare_v2(db, "SELECT id, name FROM users WHERE role = 'student';", -1, &nameStmt, 0) == SQLITE_OK) {
+        while (sqlite3_step(nameStmt) == SQLITE_ROW) {
+            names[sqlite3_column_int(nameStmt, 0)] = reinterpret_cast<const char*>(sqlite3_column_text(nameStmt, 1));
+        }
     }
+    sqlite3_finalize(nameStmt);
+    return names;
 }
 
-void Admin::manageFees() {
-    cout << "\n=== Manage Student Fees ===\n";
+void Admin::attendanceAnalytics() {
+    cout << "\n=== Attendance Analytics ===\n";
+    int courseId;
+    string courseName;
+    if (!selectCourse(courseId, courseName)) return;
 
-    // List students
-    string sql = "SELECT users.id, users.name, students.fees_due, students.fees_paid "
-        "FROM users JOIN students ON users.id = students.user_id;";
+    int choice;
+    cout << "1. Attendance Percentages\n";
+    cout << "2. Consecutive Absences\n";
+    cout << "3. Below Attendance Threshold\n";
+    cout << "Enter choice: ";
+    cin >> choice;
 
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
-        cerr << "Error: " << sqlite3_errmsg(db) << endl;
+    int length = 0;
+    double threshold = 0;
+    if (choice == 2) {
+        cout << "Consecutive classes missed: ";
+        cin >> length;
+    }
+    else if (choice == 3) {
+        cout << "Threshold (%): ";
+        cin >> threshold;
+    }
+    else if (choice != 1) {
+        cout << "Invalid choice!" << endl;
         return;
     }
 
-    vector<pair<int, pair<double, double>>> students; // id -> (due, paid)
-    cout << left << setw(5) << "ID" << setw(25) << "Name" << setw(12) << "Due" << setw(12) << "Paid" << endl;
-    cout << string(55, '-') << endl;
-
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        int id = sqlite3_column_int(stmt, 0);
-        string name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        double due = sqlite3_column_double(stmt, 2);
-        double paid = sqlite3_column_double(stmt, 3);
-        students.push_back({ id, {due, paid} });
-        cout << left << setw(5) << id << setw(25) << name
-            << setw(12) << fixed << setprecision(2) << due
-            << setw(12) << paid << endl;
+    // Build (or refresh) the bitmaps before timing the query itself
+    int classDays = attendanceBitmaps.classDays(courseId);
+    auto start = chrono::steady_clock::now();
+    vector<AttendanceBitmaps::Summary> summaries;
+    vector<int> students;
+    if (choice == 1) summaries = attendanceBitmaps.summaries(courseId);
+    else if (choice == 2) students = attendanceBitmaps.absenceStreaks(courseId, length);
+    else summaries = attendanceBitmaps.below(courseId, threshold);
+    long long micros = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+    map<int, string> names = studentNames();
+    cout << "\n" << courseName << ": " << classDays << " class days\n";
+    if (choice == 2) {
+        ReportWriter report({ { "Student" } });
+        for (int studentId : students) {
+            report.row({ names[studentId] });
+        }
     }
-    sqlite3_finalize(stmt);
+    else {
+        ReportWriter report({ { "Student" }, { "Present", true }, { "Recorded", true }, { "Percent", true } });
+        for (const auto& summary : summaries) {
+            double percent = summary.recorded ? summary.present * 100.0 / summary.recorded : 0.0;
+            report.row({ names[summary.studentId], to_string(summary.present), to_string(summary.recorded), formatNumber(percent, 1) });
+        }
+    }
+    cout << "Answered in " << micros << " us" << endl;
+}
 
-    if (students.empty()) {
-        cout << "No students found!" << endl;
+void Admin::topStudents() {
+    cout << "\n=== Top Students per Course ===\n";
+    int courseId;
+    string courseName;
+    if (!selectCourse(courseId, courseName)) return;
+
+    int k;
+    cout << "Number of students: ";
+    cin >> k;
+    if (k < 1) {
+        cout << "Invalid number!" << endl;
         return;
     }
 
-    int studentId;
-    double amount;
-    cout << "Enter Student ID to update fees: ";
-    cin >> studentId;
-    cout << "Enter payment amount: ";
-    cin >> amount;
-
-    auto it = find_if(students.begin(), students.end(),
-        [studentId](const pair<int, pair<double, double>>& s) { return s.first == studentId; });
+    vector<pair<int, double>> top = gradeRankings.top(courseId, k);
+    map<int, string> names = studentNames();
+    cout << "\n" << courseName << ":\n";
+    ReportWriter report({ { "Rank", true }, { "Student" }, { "Total", true } });
+    int rank = 0;
+    for (size_t i = 0; i < top.size(); ++i) {
+        // Tied totals share the rank of the first of them
+        if (i == 0 || top[i].second != top[i - 1].second) rank = static_cast<int>(i) + 1;
+        report.row({ to_string(rank), names[top[i].first], formatNumber(top[i].second) });
+    }
+}
 
-    if (it == students.end()) {
-        cout << "Invalid student ID!" << endl;
+void Admin::auditHistory() {
+    cout << "\n=== Audit History ===\n";
+    cout << "1. By Student\n";
+    cout << "2. By Course\n";
+    cout << "Enter choice: ";
+    int choice;
+    cin >> choice;
+    if (choice != 1 && choice != 2) {
+        cout << "Invalid choice!" << endl;
         return;
     }
+    int id;
+    cout << (choice == 1 ? "Student ID: " : "Course ID: ");
+    cin >> id;
+    showAuditHistory(choice == 2, id);
+}
 
-    double newPaid = it->second.second + amount;
-    double due = it->second.first;
+// Runs in the background so the menu stays usable while pages are copied
+thread backupThread;
+atomic<bool> backupRunning(false);
 
-    if (newPaid > due) {
-        cout << "Payment exceeds due amount! Maximum payable: $" << (due - it->second.second) << endl;
+void Admin::backupDatabase() {
+    if (backupRunning) {
+        cout << "A backup is already running!" << endl;
         return;
     }
-
-    string updateSql = "UPDATE students SET fees_paid = " + to_string(newPaid) +
-        " WHERE user_id = " + to_string(studentId) + ";";
-    if (executeSQL(updateSql.c_str())) {
-        cout << "Fees updated successfully!" << endl;
-    }
+    if (backupThread.joinable()) backupThread.join();
+
+    string dest;
+    char compress;
+    cout << "\n=== Backup Database ===\n";
+    cout << "Backup file: ";
+    cin >> dest;
+    cout << "Compress (y/n): ";
+    cin >> compress;
+
+    BackupOptions options;
+    options.compress = tolower(compress) == 'y';
+    string source = replicaMode ? replicaPath : shards[activeShard].path;
+    backupRunning = true;
+    backupThread = thread([source, dest, options] {
+        ::backupDatabase(source, dest, options);
+        backupRunning = false;
+    });
+    cout << "Backup started in the background." << endl;
 }
 
 void Admin::displayMenu() {
     int choice;
     while (true) {
+        refreshReplica();
         cout << "\n=== Admin Menu ===\n";
         cout << "1. Manage Users\n";
         cout << "2. List Users\n";
@@ -1018,7 +4346,15 @@ void Admin::displayMenu() {
         cout << "6. Add Course\n";
         cout << "7. Assign Professor\n";
         cout << "8. Manage Student Fees\n";
-        cout << "9. Logout\n";
+        cout << "9. Backup Database\n";
+        cout << "10. Attendance Analytics\n";
+        cout << "11. Top Students per Course\n";
+        cout << "12. Audit History\n";
+        cout << "13. Changes Since Last View\n";
+        cout << "14. Term Billing\n";
+        cout << "15. Alerts\n";
+        cout << "16. Query Advisor\n";
+        cout << "17. Logout\n";
         cout << "Enter choice: ";
         cin >> choice;
 
@@ -1031,23 +4367,68 @@ void Admin::displayMenu() {
         case 6: addCourse(); break;
         case 7: assignProfessor(); break;
         case 8: manageFees(); break;
-        case 9: return;
+        case 9: backupDatabase(); break;
+        case 10: attendanceAnalytics(); break;
+        case 11: topStudents(); break;
+        case 12: auditHistory(); break;
+        case 13: changesSinceLastView(); break;
+        case 14: billing(); break;
+        case 15: alerts(); break;
+        case 16: queryAdvisor(); break;
+        case 17: return;
         default: cout << "Invalid choice!" << endl;
         }
     }
 }
 
-// Initialize database schema
-void initializeDatabase() {
-    // Enable foreign keys
-    executeSQL("PRAGMA foreign_keys = ON;");
+// Bump whenever the schema or a migration below changes; startup skips all
+// DDL while PRAGMA user_version already matches
+const int schemaVersion = 6;
+
+int currentSchemaVersion() {
+    int version = 0;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "PRAGMA user_version;", -1, &stmt, 0) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return version;
+}
+
+// Adds a column that newer versions of a CREATE TABLE below already include
+bool addColumn(const string& table, const string& column, const string& definition) {
+    sqlite3_stmt* stmt;
+    bool present = false;
+    string checkSql = "SELECT 1 FROM pragma_table_info('" + table + "') WHERE name = '" + column + "';";
+    if (sqlite3_prepare_v2(db, checkSql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+        present = sqlite3_step(stmt) == SQLITE_ROW;
+    }
+    sqlite3_finalize(stmt);
+    string alterSql = "ALTER TABLE " + table + " ADD COLUMN " + column + " " + definition + ";";
+    return present || executeSQL(alterSql.c_str());
+}
+
+// Initialize database schema; returns true if the DDL had to run
+bool initializeDatabase() {
+    int fromVersion = currentSchemaVersion();
+    if (fromVersion == schemaVersion) {
+        return false;
+    }
+
+    // WAL lets readers proceed while a professor writes; the mode is stored
+    // in the file and can't change inside a transaction
+    executeSQL("PRAGMA journal_mode = WAL;");
+
+    // Everything below runs in a single transaction
+    executeSQL("BEGIN;");
+    bool ok = true;
 
     // Create tables
-    executeSQL("CREATE TABLE IF NOT EXISTS departments ("
+    ok = ok && executeSQL("CREATE TABLE IF NOT EXISTS departments ("
         "id INTEGER PRIMARY KEY AUTOINCREMENT,"
         "name TEXT NOT NULL UNIQUE);");
 
-    executeSQL("CREATE TABLE IF NOT EXISTS users ("
+    ok = ok && executeSQL("CREATE TABLE IF NOT EXISTS users ("
         "id INTEGER PRIMARY KEY AUTOINCREMENT,"
         "username TEXT NOT NULL UNIQUE,"
         "password TEXT NOT NULL,"
@@ -1056,29 +4437,29 @@ void initializeDatabase() {
         "role TEXT NOT NULL CHECK(role IN ('admin', 'professor', 'student')),"
         "department_id INTEGER REFERENCES departments(id));");
 
-    executeSQL("CREATE TABLE IF NOT EXISTS students ("
+    ok = ok && executeSQL("CREATE TABLE IF NOT EXISTS students ("
         "user_id INTEGER PRIMARY KEY REFERENCES users(id),"
         "department_id INTEGER REFERENCES departments(id),"
-        "fees_due REAL DEFAULT 5000.0,"
+        "fees_due REAL DEFAULT 0.0,"
         "fees_paid REAL DEFAULT 0.0);");
 
-    executeSQL("CREATE TABLE IF NOT EXISTS professor_departments ("
+    ok = ok && executeSQL("CREATE TABLE IF NOT EXISTS professor_departments ("
         "professor_id INTEGER REFERENCES users(id),"
         "department_id INTEGER REFERENCES departments(id),"
         "PRIMARY KEY (professor_id, department_id));");
 
-    executeSQL("CREATE TABLE IF NOT EXISTS courses ("
+    ok = ok && executeSQL("CREATE TABLE IF NOT EXISTS courses ("
         "id INTEGER PRIMARY KEY AUTOINCREMENT,"
         "name TEXT NOT NULL,"
         "department_id INTEGER REFERENCES departments(id),"
         "course_type TEXT NOT NULL CHECK(course_type IN ('theoretical', 'practical')));");
 
-    executeSQL("CREATE TABLE IF NOT EXISTS professor_courses ("
+    ok = ok && executeSQL("CREATE TABLE IF NOT EXISTS professor_courses ("
         "professor_id INTEGER REFERENCES users(id),"
         "course_id INTEGER REFERENCES courses(id),"
         "PRIMARY KEY (professor_id, course_id));");
 
-    executeSQL("CREATE TABLE IF NOT EXISTS grades ("
+    ok = ok && executeSQL("CREATE TABLE IF NOT EXISTS grades ("
         "id INTEGER PRIMARY KEY AUTOINCREMENT,"
         "student_id INTEGER REFERENCES users(id),"
         "course_id INTEGER REFERENCES courses(id),"
@@ -1088,41 +4469,666 @@ void initializeDatabase() {
         "final_exam REAL DEFAULT 0,"
         "total REAL DEFAULT 0,"
         "grade_letter TEXT,"
+        "version INTEGER NOT NULL DEFAULT 0,"
+        "change_seq INTEGER NOT NULL DEFAULT 0,"
         "UNIQUE(student_id, course_id));");
+    // Grades written before optimistic versioning get version 0, and
+    // change_seq 0 until they are next written
+    ok = ok && addColumn("grades", "version", "INTEGER NOT NULL DEFAULT 0");
+    ok = ok && addColumn("grades", "change_seq", "INTEGER NOT NULL DEFAULT 0");
+    // Rankings read one course's totals at a time
+    ok = ok && executeSQL("CREATE INDEX IF NOT EXISTS grades_course_total ON grades(course_id, total, student_id);");
+
+    // Delta reports: every grade insert/update takes the next change_seq
+    ok = ok && executeSQL("CREATE TABLE IF NOT EXISTS change_counters ("
+        "name TEXT PRIMARY KEY,"
+        "value INTEGER NOT NULL);"
+        "INSERT OR IGNORE INTO change_counters (name, value) VALUES ('grades', 0);"
+        "CREATE INDEX IF NOT EXISTS grades_change_seq ON grades(change_seq);"
+        "CREATE TRIGGER IF NOT EXISTS grades_insert_seq AFTER INSERT ON grades BEGIN "
+        "UPDATE change_counters SET value = value + 1 WHERE name = 'grades';"
+        "UPDATE grades SET change_seq = (SELECT value FROM change_counters WHERE name = 'grades') WHERE id = NEW.id;"
+        "END;"
+        "CREATE TRIGGER IF NOT EXISTS grades_update_seq "
+        "AFTER UPDATE OF assignment1, assignment2, coursework, final_exam, total, grade_letter ON grades BEGIN "
+        "UPDATE change_counters SET value = value + 1 WHERE name = 'grades';"
+        "UPDATE grades SET change_seq = (SELECT value FROM change_counters WHERE name = 'grades') WHERE id = NEW.id;"
+        "END;");
+
+    // Term billing; students from before billing keep what they owed as an
+    // opening bill, since fees_due is now the sum of a student's bills
+    ok = ok && executeSQL("CREATE TABLE IF NOT EXISTS fee_schedules ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "term TEXT NOT NULL,"
+        "department_id INTEGER REFERENCES departments(id),"
+        "course_id INTEGER REFERENCES courses(id),"
+        "amount REAL NOT NULL CHECK(amount >= 0),"
+        "CHECK((department_id IS NULL) != (course_id IS NULL)));"
+        "CREATE INDEX IF NOT EXISTS fee_schedules_term ON fee_schedules(term);"
+        "CREATE TABLE IF NOT EXISTS student_bills ("
+        "student_id INTEGER REFERENCES users(id),"
+        "term TEXT NOT NULL,"
+        "amount REAL NOT NULL,"
+        "PRIMARY KEY (student_id, term));"
+        "CREATE INDEX IF NOT EXISTS student_bills_term ON student_bills(term);"
+        "CREATE TABLE IF NOT EXISTS billing_runs ("
+        "term TEXT PRIMARY KEY,"
+        "run_at TEXT NOT NULL,"
+        "run_by INTEGER,"
+        "students INTEGER NOT NULL,"
+        "total REAL NOT NULL);");
+    // Only when billing arrives (version 4): later, fees_due already is the sum of the bills
+    if (fromVersion < 4) {
+        ok = ok && executeSQL("INSERT OR IGNORE INTO student_bills (student_id, term, amount) "
+            "SELECT user_id, 'opening', fees_due FROM students WHERE fees_due > 0;");
+    }
 
-    executeSQL("CREATE TABLE IF NOT EXISTS attendance ("
+    // Alert rules, seeded with the three checks admins used to run by hand
+    ok = ok && executeSQL("CREATE TABLE IF NOT EXISTS alert_rules ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "name TEXT NOT NULL,"
+        "source TEXT NOT NULL CHECK(source IN ('grades', 'attendance', 'fees')),"
+        "metric TEXT NOT NULL,"
+        "op TEXT NOT NULL CHECK(op IN ('<', '<=', '>', '>=')),"
+        "threshold REAL NOT NULL,"
+        "active INTEGER NOT NULL DEFAULT 1);"
+        "CREATE TABLE IF NOT EXISTS alerts ("
         "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "rule_id INTEGER REFERENCES alert_rules(id),"
         "student_id INTEGER REFERENCES users(id),"
-        "course_id INTEGER REFERENCES courses(id),"
-        "date TEXT NOT NULL,"
-        "status TEXT NOT NULL CHECK(status IN ('present', 'absent')));");
+        "course_id INTEGER NOT NULL,"
+        "value REAL NOT NULL,"
+        "raised_at TEXT NOT NULL,"
+        "resolved_at TEXT,"
+        "UNIQUE(rule_id, student_id, course_id));"
+        "CREATE INDEX IF NOT EXISTS alerts_student ON alerts(student_id, course_id);"
+        "INSERT INTO alert_rules (name, source, metric, op, threshold) SELECT * FROM ("
+        "SELECT 'Failing grade', 'grades', 'total', '<', 60 UNION ALL "
+        "SELECT 'Low attendance', 'attendance', 'rate', '<', 75 UNION ALL "
+        "SELECT 'Outstanding balance', 'fees', 'balance', '>', 0) "
+        "WHERE NOT EXISTS (SELECT 1 FROM alert_rules);");
+
+    ok = ok && executeSQL("CREATE TABLE IF NOT EXISTS report_watermarks ("
+        "admin_id INTEGER REFERENCES users(id),"
+        "shard TEXT NOT NULL,"
+        "source TEXT NOT NULL,"
+        "mark INTEGER NOT NULL,"
+        "PRIMARY KEY (admin_id, shard, source));");
+
+    // Attendance is stored in one table per term, see attendance_partitions
+    ok = ok && executeSQL("CREATE TABLE IF NOT EXISTS attendance_partitions ("
+        "term TEXT PRIMARY KEY,"
+        "archive TEXT);");
+    ok = ok && migrateLegacyAttendance();
+    ok = ok && migrateAttendanceEncoding();
 
     // Create default admin if not exists
-    executeSQL("INSERT OR IGNORE INTO users (username, password, name, email, role) "
+    ok = ok && executeSQL("INSERT OR IGNORE INTO users (username, password, name, email, role) "
         "VALUES ('admin', 'admin123', 'System Admin', 'admin@university.com', 'admin');");
+
+    string versionSql = "PRAGMA user_version = " + to_string(schemaVersion) + ";";
+    ok = ok && executeSQL(versionSql.c_str());
+    if (!ok) {
+        cerr << "Schema update failed; changes rolled back" << endl;
+        executeSQL("ROLLBACK;");
+        knownPartitions.clear();
+        return true;
+    }
+    executeSQL("COMMIT;");
+    return true;
+}
+
+// Batch transcripts: a single pass over every student's grades ordered by
+// student, grouped as the rows stream in and handed to worker threads that
+// render and write one file per student. Workers never touch the database.
+struct TranscriptLine {
+    string course;
+    double ass1, ass2, cw, final, total;
+    string grade;
+};
+
+struct Transcript {
+    int studentId = 0;
+    string name;
+    string email;
+    string department;
+    vector<TranscriptLine> lines;
+};
+
+string renderTranscript(const Transcript& transcript) {
+    string text;
+    if (outputFormat == OutputFormat::Json) {
+        text = "{\"student_id\":" + to_string(transcript.studentId)
+            + ",\"name\":" + ReportWriter::jsonString(transcript.name)
+            + ",\"email\":" + ReportWriter::jsonString(transcript.email)
+            + ",\"department\":" + ReportWriter::jsonString(transcript.department) + ",\"courses\":[";
+        for (size_t i = 0; i < transcript.lines.size(); ++i) {
+            const TranscriptLine& line = transcript.lines[i];
+            text += (i ? ",\n{" : "\n{");
+            text += "\"course\":" + ReportWriter::jsonString(line.course)
+                + ",\"assignment1\":" + formatNumber(line.ass1) + ",\"assignment2\":" + formatNumber(line.ass2)
+                + ",\"coursework\":" + formatNumber(line.cw) + ",\"final_exam\":" + formatNumber(line.final)
+                + ",\"total\":" + formatNumber(line.total) + ",\"grade\":" + ReportWriter::jsonString(line.grade) + "}";
+        }
+        return text + "]}\n";
+    }
+    if (outputFormat == OutputFormat::Csv) {
+        text = "Course,Ass1,Ass2,CW,Final,Total,Grade\n";
+        for (const auto& line : transcript.lines) {
+            string course = line.course;
+            if (course.find_first_of(",\"\n\r") != string::npos) {
+                string quoted = "\"";
+                for (char c : course) {
+                    if (c == '"') quoted += '"';
+                    quoted += c;
+                }
+                course = quoted + "\"";
+            }
+            text += course + "," + formatNumber(line.ass1) + "," + formatNumber(line.ass2) + "," + formatNumber(line.cw)
+                + "," + formatNumber(line.final) + "," + formatNumber(line.total) + "," + line.grade + "\n";
+        }
+        return text;
+    }
+
+    text = "=== Transcript ===\n";
+    text += "Student ID: " + to_string(transcript.studentId) + "\n";
+    text += "Name: " + transcript.name + "\n";
+    text += "Email: " + transcript.email + "\n";
+    if (!transcript.department.empty()) text += "Department: " + transcript.department + "\n";
+    text += "\n";
+    if (transcript.lines.empty()) {
+        return text + "No grades recorded.\n";
+    }
+
+    size_t courseWidth = 6;
+    for (const auto& line : transcript.lines) courseWidth = max(courseWidth, line.course.size());
+    char row[512];
+    snprintf(row, sizeof(row), "%-*s  %6s  %6s  %6s  %6s  %6s  %s\n", static_cast<int>(courseWidth), "Course",
+        "Ass1", "Ass2", "CW", "Final", "Total", "Grade");
+    text += row;
+    text += string(courseWidth + 48, '-') + "\n";
+    double sum = 0;
+    for (const auto& line : transcript.lines) {
+        snprintf(row, sizeof(row), "%-*s  %6s  %6s  %6s  %6s  %6s  %s\n", static_cast<int>(courseWidth), line.course.c_str(),
+            formatNumber(line.ass1).c_str(), formatNumber(line.ass2).c_str(), formatNumber(line.cw).c_str(),
+            formatNumber(line.final).c_str(), formatNumber(line.total).c_str(), line.grade.c_str());
+        text += row;
+        sum += line.total;
+    }
+    text += "\nAverage total: " + formatNumber(sum / transcript.lines.size()) + "\n";
+    return text;
 }
 
-int main() {
-    // Open database connection
-    if (sqlite3_open("university.db", &db)) {
-        cerr << "Can't open database: " << sqlite3_errmsg(db) << endl;
+// Bounded hand-off between the query and the writers, so a large cohort
+// never sits in memory all at once
+class TranscriptQueue {
+private:
+    static const size_t capacity = 256;
+    mutex lock;
+    condition_variable changed;
+    deque<Transcript> items;
+    bool closed = false;
+public:
+    void push(Transcript transcript) {
+        unique_lock<mutex> guard(lock);
+        changed.wait(guard, [this] { return items.size() < capacity; });
+        items.push_back(move(transcript));
+        changed.notify_all();
+    }
+
+    // Returns false once the queue is closed and drained
+    bool pop(Transcript& transcript) {
+        unique_lock<mutex> guard(lock);
+        changed.wait(guard, [this] { return !items.empty() || closed; });
+        if (items.empty()) return false;
+        transcript = move(items.front());
+        items.pop_front();
+        changed.notify_all();
+        return true;
+    }
+
+    void close() {
+        lock_guard<mutex> guard(lock);
+        closed = true;
+        changed.notify_all();
+    }
+};
+
+int generateTranscripts(const string& outDir, int workers) {
+    error_code error;
+    filesystem::create_directories(outDir, error);
+    if (error) {
+        cerr << "Can't create " << outDir << ": " << error.message() << endl;
+        return 1;
+    }
+
+    const char* sql = "SELECT users.id, users.name, users.email, COALESCE(departments.name, ''), "
+        "courses.name, grades.assignment1, grades.assignment2, grades.coursework, grades.final_exam, "
+        "grades.total, COALESCE(grades.grade_letter, '') "
+        "FROM users "
+        "LEFT JOIN departments ON users.department_id = departments.id "
+        "LEFT JOIN grades ON grades.student_id = users.id "
+        "LEFT JOIN courses ON grades.course_id = courses.id "
+        "WHERE users.role = 'student' "
+        "ORDER BY users.id, courses.name;";
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK) {
+        cerr << "Error preparing statement: " << sqlite3_errmsg(db) << endl;
         return 1;
     }
 
-    // Initialize database schema
-    initializeDatabase();
+    string extension = outputFormat == OutputFormat::Json ? ".json" : outputFormat == OutputFormat::Csv ? ".csv" : ".txt";
+    TranscriptQueue queue;
+    atomic<int> written(0), failed(0);
+    vector<thread> writers;
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < workers; ++i) {
+        writers.emplace_back([&] {
+            Transcript transcript;
+            while (queue.pop(transcript)) {
+                string text = renderTranscript(transcript);
+                string path = outDir + "/student_" + to_string(transcript.studentId) + extension;
+                FILE* file = openFile(path, "wb");
+                bool ok = file && fwrite(text.data(), 1, text.size(), file) == text.size();
+                if (file && fclose(file) != 0) ok = false;
+                if (ok) ++written;
+                else ++failed;
+            }
+        });
+    }
+
+    Transcript current;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int studentId = sqlite3_column_int(stmt, 0);
+        if (studentId != current.studentId) {
+            if (current.studentId) queue.push(move(current));
+            current = Transcript();
+            current.studentId = studentId;
+            current.name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            current.email = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+            current.department = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+        }
+        // Students without grades still get a transcript, with no lines
+        if (sqlite3_column_type(stmt, 4) != SQLITE_NULL) {
+            current.lines.push_back({ reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4)),
+                sqlite3_column_double(stmt, 5), sqlite3_column_double(stmt, 6), sqlite3_column_double(stmt, 7),
+                sqlite3_column_double(stmt, 8), sqlite3_column_double(stmt, 9),
+                reinterpret_cast<const char*>(sqlite3_column_text(stmt, 10)) });
+        }
+    }
+    if (current.studentId) queue.push(move(current));
+    if (rc != SQLITE_DONE) {
+        cerr << "Error reading grades: " << sqlite3_errmsg(db) << endl;
+    }
+    sqlite3_finalize(stmt);
+    queue.close();
+    for (auto& writer : writers) writer.join();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    cout << written << " transcripts written to " << outDir << " in " << fixed << setprecision(3) << seconds << "s ("
+        << setprecision(0) << (seconds > 0 ? written / seconds : 0) << " students/s, " << workers << " workers)" << endl;
+    if (failed) {
+        cerr << failed << " transcripts could not be written" << endl;
+    }
+    return rc == SQLITE_DONE && !failed ? 0 : 1;
+}
+
+// Integrity verifier (--verify): checks are split into independent tasks
+// (one per table or attendance partition, and rowid ranges of the big
+// tables) that worker threads run on their own read-only connections.
+struct VerifyTask {
+    string check;
+    string table;
+    string sql;     // one row per violation, first column describes it
+    string archive; // attached read-only as "archive" while the task runs
+};
+
+struct VerifyResult {
+    long long violations = 0;
+    vector<string> examples;
+    string error;
+};
+
+const sqlite3_int64 verifyChunkRows = 250000;
+
+// Tasks over rowid ranges of table, so large tables spread across workers
+void addRangeTasks(vector<VerifyTask>& tasks, const string& check, const string& table, const string& sql) {
+    sqlite3_int64 maxRowid = 0;
+    sqlite3_stmt* stmt;
+    string maxSql = "SELECT COALESCE(MAX(rowid), 0) FROM " + table + ";";
+    if (sqlite3_prepare_v2(db, maxSql.c_str(), -1, &stmt, 0) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        maxRowid = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    for (sqlite3_int64 low = 0; low <= maxRowid; low += verifyChunkRows) {
+        string range = table + ".rowid BETWEEN " + to_string(low) + " AND " + to_string(low + verifyChunkRows - 1);
+        string chunkSql = sql;
+        chunkSql.replace(chunkSql.find("$RANGE"), 6, range);
+        tasks.push_back({ check, table, chunkSql, "" });
+    }
+}
+
+vector<VerifyTask> verifyTasks() {
+    vector<VerifyTask> tasks;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "SELECT name FROM sqlite_master WHERE type = 'table' AND name NOT LIKE 'sqlite_%' ORDER BY name;", -1, &stmt, 0) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            string table = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            tasks.push_back({ "foreign keys", table, "SELECT 'rowid ' || rowid || ' -> ' || parent FROM pragma_foreign_key_check('" + table + "');", "" });
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    addRangeTasks(tasks, "orphaned students", "students",
+        "SELECT 'user_id ' || students.user_id FROM students LEFT JOIN users ON users.id = students.user_id "
+        "WHERE $RANGE AND (users.id IS NULL OR users.role <> 'student');");
+    addRangeTasks(tasks, "orphaned users", "users",
+        "SELECT 'user ' || users.id || ' (' || users.username || ')' FROM users "
+        "WHERE $RANGE AND users.role = 'student' AND NOT EXISTS (SELECT 1 FROM students WHERE students.user_id = users.id);");
+    addRangeTasks(tasks, "grades out of range", "grades",
+        "SELECT 'grade ' || grades.id || ' (student ' || grades.student_id || ', course ' || grades.course_id || ')' FROM grades "
+        "WHERE $RANGE AND (assignment1 NOT BETWEEN 0 AND 100 OR assignment2 NOT BETWEEN 0 AND 100 "
+        "OR coursework NOT BETWEEN 0 AND 100 OR final_exam NOT BETWEEN 0 AND 100 OR total NOT BETWEEN 0 AND 100);");
+
+    for (const auto& partition : attendancePartitions("0000-01-01", "9999-12-31")) {
+        string table = (partition.archive.empty() ? "" : "archive.") + partition.table;
+        tasks.push_back({ "duplicate attendance", partition.table,
+            "SELECT 'student ' || student_id || ', course ' || course_id || ', ' || date(day * 86400, 'unixepoch') || ' x' || COUNT(*) "
+            "FROM " + table + " GROUP BY student_id, course_id, day HAVING COUNT(*) > 1;", partition.archive });
+    }
+    return tasks;
+}
+
+VerifyResult runVerifyTask(sqlite3* conn, const VerifyTask& task) {
+    VerifyResult result;
+    if (!task.archive.empty()) {
+        string attachSql = "ATTACH DATABASE 'file:" + task.archive + "?mode=ro' AS archive;";
+        if (sqlite3_exec(conn, attachSql.c_str(), 0, 0, 0) != SQLITE_OK) {
+            result.error = sqlite3_errmsg(conn);
+            return result;
+        }
+    }
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(conn, task.sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+        result.error = sqlite3_errmsg(conn);
+    }
+    else {
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            if (++result.violations <= 5) {
+                const unsigned char* text = sqlite3_column_text(stmt, 0);
+                result.examples.push_back(text ? reinterpret_cast<const char*>(text) : "");
+            }
+        }
+        if (rc != SQLITE_DONE) result.error = sqlite3_errmsg(conn);
+    }
+    sqlite3_finalize(stmt);
+    if (!task.archive.empty()) sqlite3_exec(conn, "DETACH DATABASE archive;", 0, 0, 0);
+    return result;
+}
+
+int verifyDatabases(int threads) {
+    ReportWriter report(shardColumns({ { "Check" }, { "Table" }, { "Violations", true }, { "Examples" } }));
+    long long violations = 0, bytes = 0;
+    size_t taskCount = 0;
+    bool failed = false;
+    auto begin = chrono::steady_clock::now();
+    for (size_t shard = 0; shard < shards.size(); ++shard) {
+        activateShard(shard);
+        vector<VerifyTask> tasks = verifyTasks();
+        taskCount += tasks.size();
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "SELECT page_count * page_size FROM pragma_page_count(), pragma_page_size();", -1, &stmt, 0) == SQLITE_OK
+            && sqlite3_step(stmt) == SQLITE_ROW) {
+            bytes += sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+        for (const auto& partition : attendancePartitions("0000-01-01", "9999-12-31")) {
+            error_code error;
+            if (!partition.archive.empty()) bytes += static_cast<long long>(filesystem::file_size(partition.archive, error));
+        }
+
+        vector<VerifyResult> results(tasks.size());
+        atomic<size_t> next(0);
+        vector<thread> workers;
+        string uri = "file:" + shards[shard].path + "?mode=ro";
+        for (int i = 0; i < threads; ++i) {
+            workers.emplace_back([&] {
+                sqlite3* conn;
+                if (sqlite3_open_v2(uri.c_str(), &conn, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI, 0) != SQLITE_OK) {
+                    for (size_t task; (task = next++) < tasks.size();) results[task].error = sqlite3_errmsg(conn);
+                    sqlite3_close(conn);
+                    return;
+                }
+                configureConnection(conn);
+                for (size_t task; (task = next++) < tasks.size();) {
+                    results[task] = runVerifyTask(conn, tasks[task]);
+                }
+                sqlite3_close(conn);
+            });
+        }
+        for (auto& worker : workers) worker.join();
+
+        // Range tasks of one check are reported as a single row
+        for (size_t i = 0; i < tasks.size();) {
+            long long count = 0;
+            vector<string> examples;
+            string error;
+            size_t j = i;
+            for (; j < tasks.size() && tasks[j].check == tasks[i].check && tasks[j].table == tasks[i].table; ++j) {
+                count += results[j].violations;
+                for (const auto& example : results[j].examples) {
+                    if (examples.size() < 5) examples.push_back(example);
+                }
+                if (error.empty()) error = results[j].error;
+            }
+            string exampleText = error.empty() ? "" : "error: " + error;
+            for (const auto& example : examples) exampleText += (exampleText.empty() ? "" : "; ") + example;
+            if (count > static_cast<long long>(examples.size())) exampleText += "; ...";
+            vector<string> row = { tasks[i].check, tasks[i].table, to_string(count), exampleText };
+            if (shards.size() > 1) row.insert(row.begin(), shards[shard].name);
+            report.row(row);
+            violations += count;
+            failed = failed || !error.empty();
+            i = j;
+        }
+    }
+    activateShard(0);
+    report.finish();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    cout << "Verified " << fixed << setprecision(1) << bytes / 1048576.0 << " MB in " << setprecision(3) << seconds << "s ("
+        << setprecision(1) << (seconds > 0 ? bytes / 1048576.0 / seconds : 0) << " MB/s, " << taskCount << " tasks, "
+        << threads << " threads): " << violations << " violations" << endl;
+    return violations == 0 && !failed ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    auto startupBegin = chrono::steady_clock::now();
+
+    // Global options, accepted before any command:
+    //   --format table|csv|json   listing format
+    //   --timing                  report startup time on stderr
+    //   --advisor                 profile statements for the query advisor
+    //   --shard name=path         open one database per campus (repeatable);
+    //                             commands below act on the first shard
+    bool timing = false;
+    while (argc > 1) {
+        string option = argv[1];
+        int consumed = 0;
+        if (option == "--format" && argc > 2) {
+            string format = argv[2];
+            if (format == "csv") outputFormat = OutputFormat::Csv;
+            else if (format == "json") outputFormat = OutputFormat::Json;
+            else if (format != "table") {
+                cerr << "Unknown format: " << format << endl;
+                return 1;
+            }
+            consumed = 2;
+        }
+        else if (option == "--timing") {
+            timing = true;
+            consumed = 1;
+        }
+        else if (option == "--advisor") {
+            advisorEnabled = true;
+            consumed = 1;
+        }
+        else if (option == "--shard" && argc > 2) {
+            string spec = argv[2];
+            size_t eq = spec.find('=');
+            if (eq == string::npos || eq == 0 || eq + 1 == spec.size()) {
+                cerr << "Expected --shard name=path, got: " << spec << endl;
+                return 1;
+            }
+            shards.push_back({ spec.substr(0, eq), spec.substr(eq + 1) });
+            consumed = 2;
+        }
+        else {
+            break;
+        }
+        argv[consumed] = argv[0];
+        argv += consumed;
+        argc -= consumed;
+    }
+
+    // Replica mode: --replica <primary.db> [--refresh seconds]
+    if (argc > 2 && string(argv[1]) == "--replica") {
+        int refreshSeconds = (argc > 4 && string(argv[3]) == "--refresh") ? max(1, atoi(argv[4])) : 60;
+        if (!startReplica(argv[2], refreshSeconds)) {
+            return 1;
+        }
+        cout << "Read-only replica of " << argv[2] << ", refreshed every " << refreshSeconds << "s\n";
+        argc = 1;
+    }
+    else {
+        // Open database connections, one per shard
+        if (shards.empty()) {
+            shards.push_back({ "main", databasePath });
+        }
+        bool schemaApplied = false;
+        chrono::steady_clock::duration openTime(0);
+        for (size_t i = 0; i < shards.size(); ++i) {
+            auto& shard = shards[i];
+            auto openBegin = chrono::steady_clock::now();
+            if (sqlite3_open_v2(shard.path.c_str(), &shard.conn, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI, 0)) {
+                cerr << "Can't open database: " << sqlite3_errmsg(shard.conn) << endl;
+                return 1;
+            }
+            openTime += chrono::steady_clock::now() - openBegin;
+
+            // Initialize database schema; activating the shard drops the
+            // previous shard's cached partitions and switches the logs
+            activateShard(i);
+            configureConnection(db);
+            schemaApplied = initializeDatabase() || schemaApplied;
+            if (currentSchemaVersion() != schemaVersion) {
+                cerr << "Can't migrate " << shard.name << " (" << shard.path << ")" << endl;
+                return 1;
+            }
+            sqlite3_update_hook(db, onRowChange, nullptr);
+            sqlite3_rollback_hook(db, onRollback, nullptr);
+            if (advisorEnabled) sqlite3_trace_v2(db, SQLITE_TRACE_PROFILE, onProfile, nullptr);
+        }
+        db = nullptr;
+        activateShard(0);
+        auto opened = startupBegin + openTime;
+
+        if (timing) {
+            auto ready = chrono::steady_clock::now();
+            cerr << "Startup: " << fixed << setprecision(2)
+                << chrono::duration<double, milli>(ready - startupBegin).count() << " ms (open "
+                << chrono::duration<double, milli>(opened - startupBegin).count() << " ms, schema "
+                << chrono::duration<double, milli>(ready - opened).count() << " ms, "
+                << (schemaApplied ? "DDL applied" : "DDL skipped") << ")" << endl;
+        }
+    }
+
+    // Command mode:
+    //   --cdc-tail [offset], --cdc-replay <target.db> [offset]
+    //   --backup <file> [--step pages] [--sleep ms] [--compress], --restore <file> <target.db>
+    //   --archive-attendance <term>
+    //   --transcripts <dir> [--workers n]   one file per student, in --format
+    //   --audit student|course <id>
+    //   --bill <term>                       apply the term's fee schedules
+    //   --analyze                           refresh planner statistics (for cron)
+    //   --verify [--threads n]              integrity checks on read-only connections
+    if (argc > 1) {
+        string command = argv[1];
+        int status = 1;
+        if (command == "--cdc-tail") {
+            status = tailChangeLog(argc > 2 ? atoll(argv[2]) : 0);
+        }
+        else if (command == "--cdc-replay" && argc > 2) {
+            status = replayChangeLog(argv[2], argc > 3 ? atoll(argv[3]) : 0);
+        }
+        else if (command == "--backup" && argc > 2) {
+            BackupOptions options;
+            options.progress = true;
+            for (int i = 3; i < argc; ++i) {
+                string option = argv[i];
+                if (option == "--step" && i + 1 < argc) options.pagesPerStep = max(1, atoi(argv[++i]));
+                else if (option == "--sleep" && i + 1 < argc) options.sleepMs = max(0, atoi(argv[++i]));
+                else if (option == "--compress") options.compress = true;
+            }
+            status = backupDatabase(shards[activeShard].path, argv[2], options) ? 0 : 1;
+        }
+        else if (command == "--archive-attendance" && argc > 2) {
+            status = archiveAttendanceTerm(argv[2]);
+        }
+        else if (command == "--audit" && argc > 3 && (string(argv[2]) == "student" || string(argv[2]) == "course")) {
+            status = showAuditHistory(string(argv[2]) == "course", atoi(argv[3]));
+        }
+        else if (command == "--verify") {
+            int threads = max(1, static_cast<int>(thread::hardware_concurrency()));
+            if (argc > 3 && string(argv[2]) == "--threads") threads = max(1, atoi(argv[3]));
+            status = verifyDatabases(threads);
+        }
+        else if (command == "--analyze") {
+            auto begin = chrono::steady_clock::now();
+            status = executeSQL("ANALYZE;") ? 0 : 1;
+            cout << "Statistics refreshed in " << fixed << setprecision(1)
+                << chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count() << " ms" << endl;
+        }
+        else if (command == "--bill" && argc > 2) {
+            status = runBilling(argv[2]);
+        }
+        else if (command == "--transcripts" && argc > 2) {
+            int workers = max(1, static_cast<int>(thread::hardware_concurrency()));
+            if (argc > 4 && string(argv[3]) == "--workers") workers = max(1, atoi(argv[4]));
+            status = generateTranscripts(argv[2], workers);
+        }
+        else if (command == "--restore" && argc > 3) {
+            status = decompressFile(argv[2], argv[3]) ? 0 : 1;
+            cout << (status == 0 ? "Backup restored to " + string(argv[3]) : "Not a compressed backup: " + string(argv[2])) << endl;
+        }
+        else {
+            cerr << "Unknown command: " << command << endl;
+        }
+        if (advisorEnabled) {
+            reportQueryProfile();
+        }
+        for (auto& shard : shards) {
+            sqlite3_close(shard.conn);
+        }
+        return status;
+    }
 
     cout << "University Management System\n";
     cout << "---------------------------\n";
 
     while (true) {
-        User* currentUser = login();
-        if (!currentUser) continue;
+        refreshReplica();
+        Session session = login();
+        if (!session) continue;
 
-        currentUser->displayMenu();
-        delete currentUser;
+        session->displayMenu();
+        optimizeDatabase();
     }
 
-    sqlite3_close(db);
+    for (auto& shard : shards) {
+        sqlite3_close(shard.conn);
+    }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,77 @@
+"""Regression tests for --archive-attendance.
+
+Run against a built binary:
+    UNIVERSITY_CLI=path/to/UniversityProjectCLI python -m unittest discover UniversityProjectCLI/tests
+"""
+import os
+import shutil
+import sqlite3
+import subprocess
+import tempfile
+import unittest
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SAMPLE_DB = os.path.join(HERE, "..", "university.db")
+CLI = os.environ.get("UNIVERSITY_CLI")
+
+
+def run(args, cwd):
+    return subprocess.run([CLI] + args, cwd=cwd, capture_output=True, text=True, timeout=60)
+
+
+@unittest.skipUnless(CLI, "set UNIVERSITY_CLI to the built binary")
+class ArchiveAttendanceTest(unittest.TestCase):
+    def setUp(self):
+        self.dir = tempfile.mkdtemp()
+        self.db = os.path.join(self.dir, "university.db")
+        shutil.copy(SAMPLE_DB, self.db)
+        # Any command migrates the sample database to the current schema
+        self.assertEqual(run(["--verify"], self.dir).returncode, 0)
+
+    def tearDown(self):
+        shutil.rmtree(self.dir)
+
+    def rows(self, path, table):
+        with sqlite3.connect(path) as conn:
+            return conn.execute("SELECT * FROM " + table + " ORDER BY id").fetchall()
+
+    def test_archive_moves_rows_to_archive_file(self):
+        before = self.rows(self.db, "attendance_2025_2")
+        self.assertTrue(before)
+
+        result = run(["--archive-attendance", "2025_2"], self.dir)
+        self.assertEqual(result.returncode, 0, result.stderr)
+
+        with sqlite3.connect(self.db) as conn:
+            archive = conn.execute("SELECT archive FROM attendance_partitions WHERE term = '2025_2'").fetchone()[0]
+            tables = [row[0] for row in conn.execute("SELECT name FROM sqlite_master WHERE name = 'attendance_2025_2'")]
+        self.assertEqual(tables, [])
+        self.assertEqual(self.rows(os.path.join(self.dir, archive), "attendance_2025_2"), before)
+
+        # The archived partition is still checked (read-only) and clean
+        result = run(["--verify"], self.dir)
+        self.assertEqual(result.returncode, 0, result.stdout)
+
+    def test_archive_lives_next_to_database(self):
+        # Two campuses in one directory, archived from somewhere else
+        elsewhere = os.path.join(self.dir, "elsewhere")
+        os.mkdir(elsewhere)
+        campuses = {}
+        for name in ("north", "south"):
+            path = os.path.join(self.dir, name + ".db")
+            shutil.copy(self.db, path)
+            campuses[name] = self.rows(path, "attendance_2025_2")
+        for name in campuses:
+            result = run(["--shard", "main=" + os.path.join(self.dir, name + ".db"), "--archive-attendance", "2025_2"], elsewhere)
+            self.assertEqual(result.returncode, 0, result.stderr)
+
+        self.assertEqual(os.listdir(elsewhere), [])
+        for name, before in campuses.items():
+            with sqlite3.connect(os.path.join(self.dir, name + ".db")) as conn:
+                archive = conn.execute("SELECT archive FROM attendance_partitions WHERE term = '2025_2'").fetchone()[0]
+            self.assertEqual(archive, name + ".attendance_2025_2.db")
+            self.assertEqual(self.rows(os.path.join(self.dir, archive), "attendance_2025_2"), before)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,92 @@
+"""Regression tests for the in-memory attendance bitmaps.
+
+Run against a built binary (ideally one built with -fsanitize=address):
+    UNIVERSITY_CLI=path/to/UniversityProjectCLI python -m unittest discover UniversityProjectCLI/tests
+"""
+import csv
+import datetime
+import os
+import shutil
+import sqlite3
+import subprocess
+import tempfile
+import unittest
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SAMPLE_DB = os.path.join(HERE, "..", "university.db")
+CLI = os.environ.get("UNIVERSITY_CLI")
+
+EPOCH = datetime.date(1970, 1, 1)
+
+
+def term_of(day):
+    date = EPOCH + datetime.timedelta(days=day)
+    return "%d_%d" % (date.year, 1 if date.month <= 6 else 2)
+
+
+def session(cwd, script, done, count):
+    """Feeds script to the menus and returns the output once done has appeared
+    count times (the menus keep prompting at end of input, so the process is
+    stopped then)."""
+    process = subprocess.Popen([CLI, "--format", "csv"], cwd=cwd, stdin=subprocess.PIPE,
+                               stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    process.stdin.write(script)
+    process.stdin.close()
+    lines = []
+    try:
+        for line in process.stdout:
+            lines.append(line)
+            if sum(done in seen for seen in lines) >= count:
+                break
+    finally:
+        process.kill()
+        process.stdout.close()
+        process.wait()
+    return lines
+
+
+@unittest.skipUnless(CLI, "set UNIVERSITY_CLI to the built binary")
+class AttendanceBitmapsTest(unittest.TestCase):
+    def setUp(self):
+        self.dir = tempfile.mkdtemp()
+        self.db = os.path.join(self.dir, "university.db")
+        shutil.copy(SAMPLE_DB, self.db)
+        result = subprocess.run([CLI, "--verify"], cwd=self.dir, capture_output=True, text=True, timeout=60)
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+
+    def tearDown(self):
+        shutil.rmtree(self.dir)
+
+    def test_class_day_inserted_before_later_days(self):
+        # Course 1: a second student attends the 200 days before today and is
+        # absent on 3 days after it; youssef has only the sample's earlier day
+        today = (datetime.date.today() - EPOCH).days
+        with sqlite3.connect(self.db) as conn:
+            conn.execute("INSERT INTO users (username, password, name, email, role, department_id) "
+                         "VALUES ('second', 'x', 'Second Student', 'second@university.com', 'student', 1)")
+            second = conn.execute("SELECT last_insert_rowid()").fetchone()[0]
+            conn.execute("INSERT INTO students (user_id, department_id) VALUES (?, 1)", (second,))
+            days = [(day, 1) for day in range(today - 200, today)] + [(day, 0) for day in range(today + 1, today + 4)]
+            for day, present in days:
+                table = "attendance_" + term_of(day)
+                conn.execute("CREATE TABLE IF NOT EXISTS " + table + " (id INTEGER PRIMARY KEY, student_id INTEGER, "
+                             "course_id INTEGER, day INTEGER NOT NULL, present INTEGER NOT NULL)")
+                conn.execute("INSERT OR IGNORE INTO attendance_partitions (term) VALUES (?)", (term_of(day),))
+                conn.execute("INSERT INTO " + table + " (student_id, course_id, day, present) VALUES (?, 1, ?, ?)",
+                             (second, day, present))
+
+        analytics = "admin\nadmin123\n10\n1\n1\n"
+        script = (analytics + "17\n"
+                  # Today for both; then youssef again, now absent
+                  + "mohamed\nmohamed123\n2\n1\np\np\n2\n1\na\np\n5\n"
+                  + analytics + "17\n")
+        output = session(self.dir, script, "Answered in", 2)
+        report = output[max(i for i, line in enumerate(output) if "class days" in line):]
+        self.assertIn(": 205 class days", report[0])
+        rows = {row[0]: row[1:] for row in csv.reader(report[1:-1]) if row}
+        self.assertEqual(rows["Youssef Khaled"], ["1", "2", "50"])
+        self.assertEqual(rows["Second Student"], ["201", "204", "98.5"])
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,74 @@
+"""Regression tests for schema upgrades of existing databases.
+
+Run against a built binary:
+    UNIVERSITY_CLI=path/to/UniversityProjectCLI python -m unittest discover UniversityProjectCLI/tests
+"""
+import os
+import shutil
+import sqlite3
+import subprocess
+import tempfile
+import unittest
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SAMPLE_DB = os.path.join(HERE, "..", "university.db")
+CLI = os.environ.get("UNIVERSITY_CLI")
+
+
+def run(args, cwd):
+    return subprocess.run([CLI] + args, cwd=cwd, capture_output=True, text=True, timeout=60)
+
+
+@unittest.skipUnless(CLI, "set UNIVERSITY_CLI to the built binary")
+class SchemaUpgradeTest(unittest.TestCase):
+    def setUp(self):
+        self.dir = tempfile.mkdtemp()
+        self.db = os.path.join(self.dir, "university.db")
+        shutil.copy(SAMPLE_DB, self.db)
+
+    def tearDown(self):
+        shutil.rmtree(self.dir)
+
+    def upgrade(self):
+        result = run(["--verify"], self.dir)
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+
+    def query(self, sql):
+        with sqlite3.connect(self.db) as conn:
+            return conn.execute(sql).fetchall()
+
+    def test_pre_billing_fees_become_opening_bills(self):
+        owed = self.query("SELECT user_id, fees_due FROM students WHERE fees_due > 0 ORDER BY user_id")
+        self.assertTrue(owed)
+        self.upgrade()
+        self.assertEqual(self.query("SELECT student_id, amount FROM student_bills WHERE term = 'opening' ORDER BY student_id"), owed)
+
+    def test_upgrade_from_v4_keeps_term_bills(self):
+        self.upgrade()
+        # Back to version 4 (before alert rules), with a student billed under v4
+        with sqlite3.connect(self.db) as conn:
+            conn.executescript("""
+                DROP TABLE alerts;
+                DROP TABLE alert_rules;
+                INSERT INTO fee_schedules (term, department_id, amount) VALUES ('2026_2', 1, 1000);
+                INSERT INTO users (username, password, name, email, role)
+                    VALUES ('billed', 'x', 'Billed At V4', 'billed@university.com', 'student');
+                INSERT INTO students (user_id, department_id, fees_due, fees_paid)
+                    VALUES (last_insert_rowid(), 1, 1000, 0);
+                INSERT INTO student_bills (student_id, term, amount)
+                    SELECT user_id, '2026_2', 1000 FROM students WHERE fees_due = 1000;
+                PRAGMA user_version = 4;
+            """)
+        student = "(SELECT id FROM users WHERE username = 'billed')"
+
+        self.upgrade()
+        self.assertEqual(self.query("PRAGMA user_version"), [(6,)])
+        self.assertEqual(self.query("SELECT term, amount FROM student_bills WHERE student_id = " + student), [("2026_2", 1000.0)])
+
+        result = run(["--bill", "2026_2"], self.dir)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(self.query("SELECT fees_due FROM students WHERE user_id = " + student), [(1000.0,)])
+
+
+if __name__ == "__main__":
+    unittest.main()